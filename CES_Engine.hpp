@@ -7,6 +7,7 @@
     #include <filesystem>
     #include <type_traits>
     #include <functional>
+    #include <exception>
     #include <stack>
     #include <string>
     #include <unordered_set>
@@ -16,6 +17,8 @@
     #include <mutex>
     #include <atomic>
     #include <condition_variable>
+    #include <latch>
+    #include <span>
     #include <queue>
     #include <variant>
     #include <fstream>
@@ -23,6 +26,13 @@
     #include <regex>
     #include <cstring>
     #include <tuple>
+    #include <bit>
+    #include <chrono>
+    #include <ctime>
+
+    #if defined(__SSE2__)
+        #include <emmintrin.h>
+    #endif
 
     namespace fs = std::filesystem;
 
@@ -37,6 +47,10 @@
         #include <fcntl.h>
         #include <climits>
         #include <linux/input.h>
+        #include <sys/ioctl.h>
+        #include <sys/uio.h>
+        #include <poll.h>
+        #include <csignal>
     #endif
 
     #if defined(__APPLE__)
@@ -47,6 +61,9 @@
         #include <sys/ioctl.h>
         #include <cstdio>
         #include <sys/types.h>
+        #include <sys/uio.h>
+        #include <poll.h>
+        #include <csignal>
     #endif
 
 using namespace std;
@@ -56,53 +73,125 @@ class CES {
         CES() = default;
 
         // Everything is based on those three structures; Every type of systems you are choosing is based on it.
+        // 4 bytes; Packed into one uint32_t as 0xRRGGBBAA by 'to_uint()', which is what the screen stores.
         struct CES_COLOR {
-            uint16_t r = 0; // red
-            uint16_t g = 0; // green
-            uint16_t b = 0; // blue
-            uint16_t a = 0; // alpha
-
-            CES_COLOR(uint8_t red = 0, uint8_t green = 0, uint8_t blue = 0, uint8_t alpha = 255) {
-                r = red;
-                g = green;
-                b = blue;
-                a = alpha;
-            }
+            uint8_t r = 0; // red
+            uint8_t g = 0; // green
+            uint8_t b = 0; // blue
+            uint8_t a = 0; // alpha
 
-            uint32_t to_uint() const noexcept {
+            constexpr CES_COLOR(uint8_t red = 0, uint8_t green = 0, uint8_t blue = 0, uint8_t alpha = 255) noexcept
+                : r(red), g(green), b(blue), a(alpha) {}
+
+            constexpr uint32_t to_uint() const noexcept {
                 return (uint32_t(r) << 24) |
                     (uint32_t(g) << 16) |
                     (uint32_t(b) << 8 ) |
                     uint32_t(a);
             }
 
-            inline void Convert_Without_Alpha(int color) noexcept {
-                r = color << 24;
-                g = color << 16;
-                b = color << 8;
+            static constexpr CES_COLOR from_uint(uint32_t v) noexcept {
+                return CES_COLOR(uint8_t(v >> 24), uint8_t(v >> 16), uint8_t(v >> 8), uint8_t(v));
             }
 
-            bool operator==(const CES_COLOR& c) const noexcept {
-                if (c.a == a && c.r == r && c.b == b && c.g == g) return true;
-                return false;
-            };
+            // 'color' as 0xRRGGBB; The alpha stays.
+            constexpr void Convert_Without_Alpha(int color) noexcept {
+                r = uint8_t(color >> 16);
+                g = uint8_t(color >> 8);
+                b = uint8_t(color);
+            }
+
+            // One compare of all 4 bytes.
+            constexpr bool operator==(const CES_COLOR& c) const noexcept { return to_uint() == c.to_uint(); }
         };
+        static_assert(sizeof(CES_COLOR) == 4);
 
         struct ColorHash {
             size_t operator()(const CES_COLOR& c) const noexcept {
-                uint32_t packed =
-                    (c.r << 24) |
-                    (c.g << 16) |
-                    (c.b << 8 ) |
-                    (c.a);
-                return hash<uint32_t>()(packed);
+                return hash<uint32_t>()(c.to_uint());
             }
         };
 
         struct ColorEq {
             bool operator()(const CES_COLOR& a, const CES_COLOR& b) const noexcept {
-                return a.r==b.r && a.g==b.g && a.b==b.b && a.a==b.a;
+                return a == b;
+            }
+        };
+
+        // !
+        // ! The palettes of 8, 16 and 256 color terminals and the nearest index of them for every color.
+        // ! Looked up in tables of 32 x 32 x 32 (5 bits per component), which are built once, when they are needed the first time.
+        // !
+        struct CES_Palette {
+            // The 16 colors as 0xRRGGBB (like the CES_16_* of the color unit), in the order of the SGR codes: 30-37, then 90-97.
+            static constexpr uint32_t ansi[16] = {
+                0x000000, 0x800000, 0x008000, 0x808000, 0x000080, 0x800080, 0x008080, 0xC0C0C0,
+                0x808080, 0xFF0000, 0x00FF00, 0xFFFF00, 0x0000FF, 0xFF00FF, 0x00FFFF, 0xFFFFFF
+            };
+
+            uint8_t to8[32768];
+            uint8_t to16[32768];
+            uint8_t to256[32768];       // 16 - 255; The first 16 are left out, every terminal has its own ones.
+
+            static const CES_Palette& get() {
+                static const CES_Palette palette;
+                return palette;
+            }
+
+            // 0xRRGGBB of one of the 256 colors: The 16, a 6x6x6 cube and 24 grays.
+            static constexpr uint32_t rgb256(int n) noexcept {
+                if (n < 16) return ansi[n];
+                if (n >= 232) {
+                    uint32_t v = 8 + 10 * (n - 232);
+                    return v << 16 | v << 8 | v;
+                }
+                n -= 16;
+                auto level = [](int s) -> uint32_t { return s ? 55 + 40 * s : 0; };
+                return level(n / 36) << 16 | level(n / 6 % 6) << 8 | level(n % 6);
             }
+
+            // Ordered dithering (4x4 Bayer): What is added to every component at (x, y); 'step' is the distance between the colors of the palette.
+            static inline int dither(int x, int y, int step) noexcept {
+                static constexpr int8_t bayer[4][4] = { { 0, 8, 2, 10 }, { 12, 4, 14, 6 }, { 3, 11, 1, 9 }, { 15, 7, 13, 5 } };
+                return (bayer[y & 3][x & 3] - 8) * step / 16;
+            }
+
+            // Index into the tables for a color as CES_COLOR::to_uint().
+            static inline uint32_t index(uint32_t rgba, int offset = 0) noexcept {
+                auto c = [offset](int v) {
+                    v += offset;
+                    return uint32_t(v < 0 ? 0 : v > 255 ? 255 : v) >> 3;
+                };
+                return c(rgba >> 24) << 10 | c((rgba >> 16) & 0xFF) << 5 | c((rgba >> 8) & 0xFF);
+            }
+
+            private:
+                // How different two colors look; The eye sees green the best and blue the worst.
+                static inline int distance(int r, int g, int b, uint32_t rgb) noexcept {
+                    int dr = r - int(rgb >> 16), dg = g - int((rgb >> 8) & 0xFF), db = b - int(rgb & 0xFF);
+                    return 2 * dr * dr + 4 * dg * dg + 3 * db * db;
+                }
+
+                CES_Palette() {
+                    // Nearest step of the cube (0, 95, 135, 175, 215, 255).
+                    auto step = [](int v) { return v < 48 ? 0 : v < 115 ? 1 : (v - 35) / 40; };
+                    for (int i = 0; i < 32768; i++) {
+                        // The middle of all colors which end up at 'i'.
+                        int r = ((i >> 10) << 3) + 4, g = (((i >> 5) & 31) << 3) + 4, b = ((i & 31) << 3) + 4;
+
+                        int best8 = INT_MAX, best16 = INT_MAX;
+                        for (int n = 0; n < 16; n++) {
+                            int d = distance(r, g, b, ansi[n]);
+                            if (n < 8 && d < best8) { best8 = d; to8[i] = uint8_t(n); }
+                            if (d < best16) { best16 = d; to16[i] = uint8_t(n); }
+                        }
+
+                        // The cube or the gray next to the average, whichever is nearer.
+                        int cube = 16 + 36 * step(r) + 6 * step(g) + step(b);
+                        int gray = 232 + min(max((r + g + b) / 3 - 3, 0) / 10, 23);
+                        to256[i] = uint8_t(distance(r, g, b, rgb256(gray)) < distance(r, g, b, rgb256(cube)) ? gray : cube);
+                    }
+                }
         };
 
         struct CES_XY {
@@ -135,104 +224,1684 @@ class CES {
                 return *this;
             }
 
-            bool operator==(const CES_XY& other) const noexcept {
-                return x == other.x
-                    && y == other.y;
-            }
+            bool operator==(const CES_XY& other) const noexcept {
+                return x == other.x
+                    && y == other.y;
+            }
+
+            bool fullEquals(const CES_XY& other) const noexcept {
+                return x == other.x && y == other.y
+                    && ARGB == other.ARGB && c == other.c && z == other.z;
+            }
+
+            struct CES_XY_Hash {
+                size_t operator()(const CES_XY& v) const noexcept {
+                    size_t h = 0;
+
+                    auto mix = [&h](size_t x) {
+                        h ^= x + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+                    };
+
+                    mix(static_cast<size_t>(v.x));
+                    mix(static_cast<size_t>(v.y));
+                    mix(static_cast<size_t>(v.z));
+                    mix(static_cast<size_t>(v.ARGB.to_uint()));
+                    mix(static_cast<size_t>(v.c));
+
+                    return h;
+                }
+            };
+
+            struct PairHash {
+                size_t operator()(const pair<int, int>& p) const noexcept {
+                    return (static_cast<size_t>(p.first) << 16) | p.second;
+                }
+            };
+
+            struct VecHash {
+                size_t operator()(const vector<CES_XY>& v) const noexcept {
+                    size_t h = 0;
+                    CES_XY_Hash hasher;
+
+                    for (const auto& p : v) {
+                        h ^= hasher(p)
+                        + 0x9e3779b97f4a7c15ULL
+                        + (h << 6)
+                        + (h >> 2);
+                    }
+                    return h;
+                }
+            };
+
+            struct VecPtrHash
+            {
+                size_t operator()(const vector<CES::CES_XY>* v) const noexcept
+                {
+                    return hash<const void*>{}(v);
+                }
+            };
+
+
+
+            string convertCHAR32toCHAR(char32_t c) const
+            {
+                string out;
+
+                if (c <= 0x7F) {
+                    out.push_back(static_cast<char>(c));
+                }
+                else if (c <= 0x7FF) {
+                    out.push_back(static_cast<char>(0xC0 | ((c >> 6) & 0x1F)));
+                    out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+                }
+                else if (c <= 0xFFFF) {
+                    out.push_back(static_cast<char>(0xE0 | ((c >> 12) & 0x0F)));
+                    out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+                    out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+                }
+                else if (c <= 0x10FFFF) {
+                    out.push_back(static_cast<char>(0xF0 | ((c >> 18) & 0x07)));
+                    out.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+                    out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+                    out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+                }
+                else {
+                    out = "\xEF\xBF\xBD";
+                }
+
+                return out;
+            }
+
+        };
+
+        struct TerminalCapabilities {
+            int supportsColor = 1;
+            bool supportsRGB = false;
+            bool supportsCursor = false;
+            bool supportsMouse = false;
+            bool supportsSyncOutput = false;    // DEC mode 2026: The terminal shows a frame only when it is complete
+        };
+
+        // Paces a loop to a fixed rate; Sleeps until an absolute deadline, so the rate doesn't drift with the work of a frame.
+        // If a frame takes longer than its budget, the missed deadlines are skipped (dropped) and the next one is used.
+        class CES_FrameClock {
+            public:
+                explicit CES_FrameClock(int fps = 60) { setTargetFPS(fps); }
+
+                void setTargetFPS(int fps) {
+                    period = 1000000000LL / max(fps, 1);
+                    deadline = 0;
+                }
+
+                // Call it at the end of every frame; Returns false if the frame missed its deadline.
+                bool wait() {
+                    int64_t t = now();
+                    if (deadline == 0) {
+                        // First frame: The budget starts now.
+                        start = t;
+                        deadline = t + period;
+                    }
+
+                    used = t - start;
+                    frames++;
+
+                    bool in_time = t <= deadline;
+                    if (!in_time) {
+                        // Every deadline which passed completely is a dropped frame; The work of it is merged into the next one.
+                        int64_t missed = (t - deadline) / period;
+                        late++;
+                        dropped += size_t(missed);
+                        deadline += (missed + 1) * period;
+                    }
+
+                    sleepUntil(deadline);
+                    start = deadline;
+                    deadline += period;
+                    return in_time;
+                }
+
+                // How much of the budget the last frame used; 1.0 = all of it.
+                double budget() const noexcept { return period ? double(used) / double(period) : 0.0; }
+
+                static int64_t now() noexcept {
+                    #if defined(__linux__)
+                        timespec ts;
+                        clock_gettime(CLOCK_MONOTONIC, &ts);
+                        return int64_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+                    #else
+                        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+                    #endif
+                }
+
+                int64_t period = 0;         // ns per frame
+                int64_t deadline = 0;       // End of the current frame
+                int64_t start = 0;          // Start of the current frame
+                int64_t used = 0;           // ns the last frame needed
+
+                size_t frames = 0;
+                size_t late = 0;            // Frames which missed their deadline
+                size_t dropped = 0;         // Deadlines which were skipped completely
+
+            private:
+                static void sleepUntil(int64_t t) {
+                    #if defined(__linux__)
+                        timespec ts;
+                        ts.tv_sec = time_t(t / 1000000000LL);
+                        ts.tv_nsec = long(t % 1000000000LL);
+                        // Absolute time; Restarted after signals.
+                        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+                    #else
+                        this_thread::sleep_until(chrono::steady_clock::time_point(chrono::nanoseconds(t)));
+                    #endif
+                }
+        };
+
+        #ifdef CES_CELL_SYSTEM
+            // Below this amount of dirty cells a band isn't worth handing to another thread.
+            #ifndef CES_BAND_MIN_CELLS
+                #define CES_BAND_MIN_CELLS 256
+            #endif
+
+            // Size of the tiles which are cached for full repaints.
+            #ifndef CES_TILE_WIDTH
+                #define CES_TILE_WIDTH 32
+            #endif
+            #ifndef CES_TILE_HEIGHT
+                #define CES_TILE_HEIGHT 8
+            #endif
+
+            // Damage tracking of the screen; One bit per cell, stored row by row.
+            // 'rows' has one bit per row, so clean rows are skipped without looking at their cells.
+            struct CES_DirtyMap {
+                int width = 0;
+                int height = 0;
+                int words = 0;              // 64-bit words per row
+                vector<uint64_t> cells;     // height * words
+                vector<uint64_t> rows;      // (height + 63) / 64
+
+                void resize(int w, int h) {
+                    width = w;
+                    height = h;
+                    words = (w + 63) / 64;
+                    cells.assign(size_t(h) * words, 0);
+                    rows.assign((h + 63) / 64, 0);
+                }
+
+                inline void mark(int x, int y) noexcept {
+                    cells[size_t(y) * words + (x >> 6)] |= uint64_t(1) << (x & 63);
+                    rows[y >> 6] |= uint64_t(1) << (y & 63);
+                }
+
+                // Marks the cells x, x+1, ... of row 'y' whose bit is set in 'bits'.
+                inline void markBits(int x, int y, uint64_t bits) noexcept {
+                    if (!bits) return;
+                    uint64_t* row = &cells[size_t(y) * words];
+                    int off = x & 63;
+                    row[x >> 6] |= bits << off;
+                    if (off && (bits >> (64 - off))) row[(x >> 6) + 1] |= bits >> (64 - off);
+                    rows[y >> 6] |= uint64_t(1) << (y & 63);
+                }
+
+                // Moves the rows [top, bottom] by 'dy' (> 0: up); The rows which come in are clean.
+                void shiftRows(int top, int bottom, int dy) {
+                    int n = bottom - top + 1, k = min(abs(dy), n);
+                    uint64_t* c = cells.data();
+                    size_t w = words;
+                    if (dy > 0) {
+                        memmove(c + top * w, c + (top + k) * w, (n - k) * w * sizeof(uint64_t));
+                        memset(c + (bottom - k + 1) * w, 0, k * w * sizeof(uint64_t));
+                    } else {
+                        memmove(c + (top + k) * w, c + top * w, (n - k) * w * sizeof(uint64_t));
+                        memset(c + top * w, 0, k * w * sizeof(uint64_t));
+                    }
+                    // The row bits of the region follow the cells.
+                    for (int y = top; y <= bottom; y++) {
+                        uint64_t any = 0;
+                        for (size_t i = 0; i < w; i++) any |= c[y * w + i];
+                        if (any) rows[y >> 6] |= uint64_t(1) << (y & 63);
+                        else rows[y >> 6] &= ~(uint64_t(1) << (y & 63));
+                    }
+                }
+
+                inline bool isDirty(int x, int y) const noexcept {
+                    return (cells[size_t(y) * words + (x >> 6)] >> (x & 63)) & 1;
+                }
+
+                inline bool rowDirty(int y) const noexcept {
+                    return (rows[y >> 6] >> (y & 63)) & 1;
+                }
+
+                // Calls f(y) for every dirty row in [y_start, y_end).
+                template <class F>
+                void forEachRow(int y_start, int y_end, F&& f) const {
+                    if (y_start >= y_end) return;
+                    for (int w = y_start >> 6; w <= (y_end - 1) >> 6; w++) {
+                        uint64_t bits = rows[w];
+                        while (bits) {
+                            int y = (w << 6) + countr_zero(bits);
+                            bits &= bits - 1;
+                            if (y < y_start) continue;
+                            if (y >= y_end) return;
+                            f(y);
+                        }
+                    }
+                }
+
+                // Calls f(x) for every dirty cell of row 'y' in [x_start, x_end); From left to right.
+                template <class F>
+                void forEachInRow(int y, int x_start, int x_end, F&& f) const {
+                    if (x_start >= x_end) return;
+                    const uint64_t* row = &cells[size_t(y) * words];
+                    int first = x_start >> 6;
+                    int last = (x_end - 1) >> 6;
+                    for (int w = first; w <= last; w++) {
+                        uint64_t bits = row[w];
+                        // Cutting off everything outside of the area.
+                        if (w == first) bits &= ~uint64_t(0) << (x_start & 63);
+                        if (w == last && (x_end & 63)) bits &= ~(~uint64_t(0) << (x_end & 63));
+                        while (bits) {
+                            f((w << 6) + countr_zero(bits));
+                            bits &= bits - 1;
+                        }
+                    }
+                }
+
+                // Amount of dirty cells of row 'y' in [x_start, x_end).
+                int countRow(int y, int x_start, int x_end) const noexcept {
+                    if (x_start >= x_end) return 0;
+                    const uint64_t* row = &cells[size_t(y) * words];
+                    int first = x_start >> 6;
+                    int last = (x_end - 1) >> 6;
+                    int n = 0;
+                    for (int w = first; w <= last; w++) {
+                        uint64_t bits = row[w];
+                        if (w == first) bits &= ~uint64_t(0) << (x_start & 63);
+                        if (w == last && (x_end & 63)) bits &= ~(~uint64_t(0) << (x_end & 63));
+                        n += popcount(bits);
+                    }
+                    return n;
+                }
+
+                // Only the dirty rows are touched.
+                void clear() noexcept {
+                    for (int w = 0; w < int(rows.size()); w++) {
+                        uint64_t bits = rows[w];
+                        while (bits) {
+                            int y = (w << 6) + countr_zero(bits);
+                            bits &= bits - 1;
+                            fill_n(&cells[size_t(y) * words], words, 0);
+                        }
+                        rows[w] = 0;
+                    }
+                }
+            };
+
+            // Bits of 'CES_Planes::attr'.
+            enum CES_CellAttr : uint8_t {
+                CES_ATTR_CONT = 0x01,       // Right half of a wide glyph; The glyph itself is in the cell to the left.
+                CES_ATTR_PIXELS = 0x02,     // Two pixels: 'rgba' is the upper one, 'bg' the lower one; The encoder picks the block glyph.
+                CES_ATTR_TINT = 0x04,       // 'rgba' and 'bg' are blended with translucent layers; The colors below are in 'CES_Screen::tints'.
+                CES_ATTR_LAYER = 0x08       // Resolved from the named layers ('CES_Screen::addLayer()'); Replaced when they change there.
+            };
+
+            // A screen buffer as structure of arrays; The position of a cell is its index: y * width + x.
+            // ! 17 bytes per cell instead of a whole 'CES_XY', and the depth test only has to read 'depth'.
+            struct CES_Planes {
+                vector<char32_t> glyph;
+                vector<uint32_t> rgba;      // CES_COLOR::to_uint()
+                vector<uint32_t> bg;        // Background, packed the same way; Alpha 0 = the background of the terminal
+                vector<int32_t> depth;      // z index
+                vector<uint8_t> attr;       // Attribute bits
+
+                void assign(size_t n, int32_t z) {
+                    glyph.assign(n, U'\0');
+                    rgba.assign(n, CES_COLOR().to_uint());
+                    bg.assign(n, 0);
+                    depth.assign(n, z);
+                    attr.assign(n, 0);
+                }
+
+                inline size_t size() const noexcept { return glyph.size(); }
+
+                inline void copy(size_t i, const CES_Planes& o, size_t j) noexcept {
+                    glyph[i] = o.glyph[j];
+                    rgba[i] = o.rgba[j];
+                    bg[i] = o.bg[j];
+                    depth[i] = o.depth[j];
+                    attr[i] = o.attr[j];
+                }
+
+                inline void put(size_t i, const CES_XY& xy) noexcept {
+                    glyph[i] = xy.c;
+                    rgba[i] = xy.ARGB.to_uint();
+                    bg[i] = 0;
+                    depth[i] = xy.z;
+                    attr[i] = 0;
+                }
+
+                // Like 'CES_DirtyMap::shiftRows'; The rows which come in are empty with the z index 'z'.
+                void shiftRows(int width, int top, int bottom, int dy, int32_t z) {
+                    int n = bottom - top + 1, k = min(abs(dy), n);
+                    size_t w = width;
+                    auto shift = [&](auto& v, auto fill) {
+                        auto* p = v.data();
+                        if (dy > 0) {
+                            memmove(p + top * w, p + (top + k) * w, (n - k) * w * sizeof(*p));
+                            fill_n(p + (bottom - k + 1) * w, k * w, fill);
+                        } else {
+                            memmove(p + (top + k) * w, p + top * w, (n - k) * w * sizeof(*p));
+                            fill_n(p + top * w, k * w, fill);
+                        }
+                    };
+                    shift(glyph, U'\0');
+                    shift(rgba, CES_COLOR().to_uint());
+                    shift(bg, 0u);
+                    shift(depth, z);
+                    shift(attr, uint8_t(0));
+                }
+            };
+
+            // !
+            // ! 'src' over 'dst' with the alpha of 'src', both as CES_COLOR::to_uint(); The result is opaque, a transparent 'dst'
+            // ! (the background of the terminal) counts as black. Fixed point: x / 255 is (x + 128 + ((x + 128) >> 8)) >> 8,
+            // ! which is exact for every product of two bytes.
+            // !
+            struct CES_Blend {
+                static constexpr uint32_t opaque(uint32_t c) noexcept { return (c & 0xFF) ? c | 0xFF : 0xFF; }
+
+                static inline uint32_t over(uint32_t src, uint32_t dst) noexcept {
+                    uint32_t a = src & 0xFF, out = 0xFF;
+                    dst = opaque(dst);
+                    for (int s = 8; s < 32; s += 8) {
+                        uint32_t x = ((src >> s) & 0xFF) * a + ((dst >> s) & 0xFF) * (255 - a) + 128;
+                        out |= ((x + (x >> 8)) >> 8) << s;
+                    }
+                    return out;
+                }
+
+                // Two colors (foreground and background of a cell) under the same 'src'; With SSE2 in one register, 8 x 16 bits.
+                static inline void over2(uint32_t src, uint32_t& a, uint32_t& b) noexcept {
+                    #if defined(__SSE2__)
+                        __m128i zero = _mm_setzero_si128();
+                        __m128i d = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, int(opaque(b)), int(opaque(a))), zero);
+                        __m128i s = _mm_unpacklo_epi8(_mm_set1_epi32(int(src)), zero);
+                        int alpha = int(src & 0xFF);
+                        __m128i x = _mm_add_epi16(_mm_mullo_epi16(s, _mm_set1_epi16(short(alpha))), _mm_mullo_epi16(d, _mm_set1_epi16(short(255 - alpha))));
+                        x = _mm_add_epi16(x, _mm_set1_epi16(128));
+                        x = _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+                        __m128i r = _mm_packus_epi16(x, zero);
+                        a = uint32_t(_mm_cvtsi128_si32(r)) | 0xFF;
+                        b = uint32_t(_mm_cvtsi128_si32(_mm_srli_si128(r, 4))) | 0xFF;
+                    #else
+                        a = over(src, a);
+                        b = over(src, b);
+                    #endif
+                }
+            };
+
+            // One translucent layer of a cell ('CES_COLOR::a' < 255).
+            struct CES_Tint {
+                int32_t z;
+                uint32_t rgba;
+            };
+
+            // The layers of a cell, sorted by z, and the colors of the cell below them, to blend them again if a layer changes.
+            struct CES_TintStack {
+                uint32_t fg = 0;
+                uint32_t bg = 0;
+                vector<CES_Tint> layers;
+            };
+
+            // Output buffer of the renderer; It only grows, so after the first frames no memory is allocated anymore.
+            // ! Aligned to a cache line: Every band has its own buffer and they are written by different threads at the same time.
+            struct alignas(64) CES_ByteBuffer {
+                struct AlignedDelete {
+                    void operator()(char* p) const noexcept { ::operator delete[](p, align_val_t(64)); }
+                };
+
+                unique_ptr<char[], AlignedDelete> buf;
+                size_t len = 0;
+                size_t cap = 0;
+
+                inline void clear() noexcept { len = 0; }
+                inline const char* data() const noexcept { return buf.get(); }
+                inline size_t size() const noexcept { return len; }
+                inline bool empty() const noexcept { return len == 0; }
+
+                void reserve(size_t n) {
+                    if (n <= cap) return;
+                    // Whole cache lines only.
+                    size_t c = (max(n, cap * 2) + 63) & ~size_t(63);
+                    unique_ptr<char[], AlignedDelete> next(static_cast<char*>(::operator new[](c, align_val_t(64))));
+                    if (len) memcpy(next.get(), buf.get(), len);
+                    buf = move(next);
+                    cap = c;
+                }
+
+                // Makes sure 'n' more bytes fit and returns where they have to be written to.
+                inline char* ensure(size_t n) {
+                    if (len + n > cap) reserve(len + n);
+                    return buf.get() + len;
+                }
+
+                inline void put(char c) { *ensure(1) = c; len++; }
+                inline void put(const char* s, size_t n) { memcpy(ensure(n), s, n); len += n; }
+                inline void put(const CES_ByteBuffer& o) { if (o.len) put(o.data(), o.len); }
+            };
+
+            // Decimal form of every number in [0, N); Calculated by the compiler.
+            template <int N>
+            struct CES_DecimalTable {
+                struct Entry { char s[4]; uint8_t n; };
+                Entry v[N];
+
+                constexpr CES_DecimalTable() : v{} {
+                    for (int i = 0; i < N; i++) {
+                        char tmp[4] = {};
+                        int n = 0;
+                        int k = i;
+                        do { tmp[n++] = char('0' + k % 10); k /= 10; } while (k && n < 4);
+                        for (int j = 0; j < n; j++) v[i].s[j] = tmp[n - 1 - j];
+                        v[i].n = uint8_t(n);
+                    }
+                }
+            };
+
+            // Which SGR form is used for colors; Decided once, from the 'TerminalCapabilities'.
+            enum CES_ColorMode {
+                CES_TRUECOLOR,  // 38;2;r;g;b
+                CES_256COLOR,   // 38;5;n
+                CES_16COLOR     // 3x / 9x
+            };
+
+            // Code points [first, last] which don't take one cell.
+            struct CES_WidthRange {
+                char32_t first, last;
+                uint8_t width;
+            };
+
+            // A code point as it is sent to the terminal.
+            struct CES_Glyph {
+                char bytes[4] = {};         // UTF-8
+                uint8_t len = 0;
+                uint8_t width = 0;          // Cells on the screen
+            };
+
+            // Writes the escape sequences straight into a 'CES_ByteBuffer'; No std::string in between.
+            struct CES_AnsiEncoder {
+                // Color components; A function-local table, since 'CES' isn't complete inside of its own body.
+                static inline const CES_DecimalTable<256>::Entry& dec_color(int v) noexcept {
+                    static constexpr CES_DecimalTable<256> table{};
+                    return table.v[v];
+                }
+
+                // Coordinates
+                static inline const CES_DecimalTable<10000>::Entry& dec_pos(int v) noexcept {
+                    static constexpr CES_DecimalTable<10000> table{};
+                    return table.v[v];
+                }
+
+                static inline void number(char* p, size_t& i, const CES_DecimalTable<256>::Entry& e) noexcept {
+                    memcpy(p + i, e.s, 4);
+                    i += e.n;
+                }
+
+                static inline void number(char* p, size_t& i, const CES_DecimalTable<10000>::Entry& e) noexcept {
+                    memcpy(p + i, e.s, 4);
+                    i += e.n;
+                }
+
+                // ESC[y;xH; x and y are 0-based here.
+                static inline void cup(CES_ByteBuffer& out, int x, int y) {
+                    char* p = out.ensure(16);
+                    size_t i = 0;
+                    p[i++] = '\033'; p[i++] = '[';
+                    number(p, i, dec_pos(min(y + 1, 9999)));
+                    // The column can be left out for the first one.
+                    if (x != 0) {
+                        p[i++] = ';';
+                        number(p, i, dec_pos(min(x + 1, 9999)));
+                    }
+                    p[i++] = 'H';
+                    out.len += i;
+                }
+
+                static inline void reset(CES_ByteBuffer& out) { out.put("\033[0m", 4); }
+
+                // ESC[top;bottomr ESC[nS (up) or ESC[nT (down); The margins have to be reset with ESC[r afterwards.
+                static inline void scroll(CES_ByteBuffer& out, int top, int bottom, int dy) {
+                    char* p = out.ensure(24);
+                    size_t i = 0;
+                    p[i++] = '\033'; p[i++] = '[';
+                    number(p, i, dec_pos(min(top + 1, 9999)));
+                    p[i++] = ';';
+                    number(p, i, dec_pos(min(bottom + 1, 9999)));
+                    p[i++] = 'r';
+                    p[i++] = '\033'; p[i++] = '[';
+                    number(p, i, dec_pos(min(abs(dy), 9999)));
+                    p[i++] = dy > 0 ? 'S' : 'T';
+                    out.len += i;
+                }
+
+                // Writes 1 to 4 bytes into 'p' and returns how many; Invalid code points become U+FFFD.
+                static inline int utf8(char* p, char32_t c) noexcept {
+                    if (c <= 0x7F) {
+                        p[0] = static_cast<char>(c);
+                        return 1;
+                    } else if (c <= 0x7FF) {
+                        p[0] = static_cast<char>(0xC0 | ((c >> 6) & 0x1F));
+                        p[1] = static_cast<char>(0x80 | (c & 0x3F));
+                        return 2;
+                    } else if (c <= 0xFFFF) {
+                        p[0] = static_cast<char>(0xE0 | ((c >> 12) & 0x0F));
+                        p[1] = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+                        p[2] = static_cast<char>(0x80 | (c & 0x3F));
+                        return 3;
+                    } else if (c <= 0x10FFFF) {
+                        p[0] = static_cast<char>(0xF0 | ((c >> 18) & 0x07));
+                        p[1] = static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+                        p[2] = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+                        p[3] = static_cast<char>(0x80 | (c & 0x3F));
+                        return 4;
+                    }
+                    memcpy(p, "\xEF\xBF\xBD", 3);
+                    return 3;
+                }
+
+                static inline void utf8(CES_ByteBuffer& out, char32_t c) {
+                    out.len += utf8(out.ensure(4), c);
+                }
+
+                // Always copies all 4 bytes, only 'len' of them count.
+                static inline void glyph(CES_ByteBuffer& out, const CES_Glyph& g) {
+                    memcpy(out.ensure(4), g.bytes, 4);
+                    out.len += g.len;
+                }
+
+                // One color as SGR parameters, from its key ('CES_OutputPlanner::key()'); 'base' is 38 for the foreground and 48 for the background.
+                // Resolved per 'CES_ColorMode' while compiling, so the hot loop never asks which one it is.
+                template <CES_ColorMode M>
+                static inline void colorParams(char* p, size_t& i, uint32_t key, int base) noexcept {
+                    // The color of the terminal (39 / 49).
+                    if (key == 0) {
+                        number(p, i, dec_color(base + 1));
+                        return;
+                    }
+                    if constexpr (M == CES_TRUECOLOR) {
+                        int r = key >> 24, g = (key >> 16) & 0xFF, b = (key >> 8) & 0xFF;
+                        number(p, i, dec_color(base));
+                        memcpy(p + i, ";2;", 3);
+                        i += 3;
+                        number(p, i, dec_color(r));
+                        p[i++] = ';';
+                        number(p, i, dec_color(g));
+                        p[i++] = ';';
+                        number(p, i, dec_color(b));
+                    } else if constexpr (M == CES_256COLOR) {
+                        number(p, i, dec_color(base));
+                        memcpy(p + i, ";5;", 3);
+                        i += 3;
+                        number(p, i, dec_color(int(key >> 8)));
+                    } else {
+                        int n = int(key >> 8);
+                        number(p, i, dec_color((n < 8 ? 30 + n : 82 + n) + base - 38));
+                    }
+                }
+
+                // Foreground and/or background in one sequence; Both as keys.
+                template <CES_ColorMode M>
+                static inline void sgr(CES_ByteBuffer& out, bool set_fg, uint32_t fg, bool set_bg, uint32_t bg) {
+                    char* p = out.ensure(40);
+                    size_t i = 2;
+                    p[0] = '\033'; p[1] = '[';
+                    if (set_fg) colorParams<M>(p, i, fg, 38);
+                    if (set_bg) {
+                        if (set_fg) p[i++] = ';';
+                        colorParams<M>(p, i, bg, 48);
+                    }
+                    p[i++] = 'm';
+                    out.len += i;
+                }
+            };
+
+            // Statistics of the last frames; 'bytes' is what the terminal had to read.
+            struct CES_FrameStats {
+                size_t frames = 0;
+                size_t bytes = 0;           // Last frame
+                size_t total_bytes = 0;
+                size_t skipped = 0;         // Frames left out, because the terminal was still busy with the ones before
+            };
+
+            // One encoded frame; Owned by the 'CES_FrameWriter', filled by the render thread.
+            struct CES_FrameSlot {
+                CES_ByteBuffer head;                        // Before the bands (scrolling)
+                vector<CES_ByteBuffer> tiles;               // One per band
+                vector<pair<const char*, size_t>> parts;    // What goes to the terminal, in this order
+                size_t bytes = 0;
+
+                inline void add(const char* p, size_t n) {
+                    parts.emplace_back(p, n);
+                    bytes += n;
+                }
+            };
+
+            // !
+            // ! What the terminal is left with after everything sent so far: The cursor and the colors (as 'CES_OutputPlanner::key()').
+            // ! Kept by the screen from one frame to the next, so a frame starts where the last one stopped.
+            // ! -1 / false = unknown.
+            // !
+            struct CES_TermState {
+                int cx = -1;
+                int cy = -1;
+                bool known_fg = false;
+                bool known_bg = false;
+                uint32_t fg = 0;
+                uint32_t bg = 0;
+            };
+
+            // !
+            // ! One tile of 'frame' for full repaints: A hash of its cells, kept up to date with every change of 'frame',
+            // ! and the bytes which draw the tile on an empty terminal. As long as the hash is the same, the bytes are too.
+            // !
+            struct CES_TileCache {
+                uint64_t hash = 0;
+                uint64_t encoded_hash = 0;  // 'hash' when 'bytes' were encoded
+                int cols = 0;               // Width of the terminal then; 0 = nothing encoded yet
+                CES_ColorMode mode = CES_16COLOR;
+                bool dither = false;
+                CES_TermState after;        // What the terminal has after 'bytes'
+                CES_ByteBuffer bytes;
+            };
+
+            // Sends the encoded frames from its own thread, so a slow terminal (or SSH) never blocks the render thread.
+            // ! Only 'SLOTS' frames can wait: If all of them are taken, the next frame isn't encoded at all and its damage stays
+            // ! for the one after it. So the terminal never gets frames that are already old.
+            class CES_FrameWriter {
+                public:
+                    static constexpr int SLOTS = 2;
+
+                    CES_FrameWriter() : worker([this] { run(); }) {}
+
+                    ~CES_FrameWriter() {
+                        drain();
+                        {
+                            lock_guard<mutex> l(mtx);
+                            stop = true;
+                        }
+                        cv.notify_all();
+                        worker.join();
+                    }
+
+                    // The cleared slot for the next frame; nullptr if every slot still waits for the terminal.
+                    CES_FrameSlot* acquire() {
+                        lock_guard<mutex> l(mtx);
+                        if (queued == SLOTS) return nullptr;
+                        CES_FrameSlot& slot = slots[(head + queued) % SLOTS];
+                        slot.head.clear();
+                        for (auto& t : slot.tiles) t.clear();
+                        slot.parts.clear();
+                        slot.bytes = 0;
+                        return &slot;
+                    }
+
+                    // Hands the slot from 'acquire()' over to the writer thread.
+                    void submit() {
+                        {
+                            lock_guard<mutex> l(mtx);
+                            queued++;
+                        }
+                        cv.notify_all();
+                    }
+
+                    // Waits until every submitted frame is written.
+                    void drain() {
+                        unique_lock<mutex> l(mtx);
+                        cv.wait(l, [this] { return queued == 0; });
+                    }
+
+                    #if !defined(_WIN32)
+                        // writev() until everything is written; Handles partial writes, signals and a non-blocking 'fd'.
+                        static bool writeAll(int fd, iovec* iov, int cnt) {
+                            while (cnt > 0) {
+                                ssize_t n = writev(fd, iov, min(cnt, IOV_MAX));
+                                if (n < 0) {
+                                    if (errno == EINTR) continue;
+                                    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                                        pollfd p = { fd, POLLOUT, 0 };
+                                        poll(&p, 1, -1);
+                                        continue;
+                                    }
+                                    return false;
+                                }
+                                // Skipping everything which is already written.
+                                while (cnt > 0 && size_t(n) >= iov->iov_len) {
+                                    n -= iov->iov_len;
+                                    iov++;
+                                    cnt--;
+                                }
+                                if (cnt > 0) {
+                                    iov->iov_base = static_cast<char*>(iov->iov_base) + n;
+                                    iov->iov_len -= n;
+                                }
+                            }
+                            return true;
+                        }
+                    #endif
+
+                private:
+                    void run() {
+                        unique_lock<mutex> l(mtx);
+                        while (true) {
+                            cv.wait(l, [this] { return stop || queued > 0; });
+                            if (queued == 0) return;
+                            CES_FrameSlot& slot = slots[head];
+                            l.unlock();
+                            send(slot);
+                            l.lock();
+                            head = (head + 1) % SLOTS;
+                            queued--;
+                            cv.notify_all();
+                        }
+                    }
+
+                    void send(CES_FrameSlot& slot) {
+                        #if defined(_WIN32)
+                            HANDLE out = GetStdHandle(STD_OUTPUT_HANDLE);
+                            for (auto& [p, n] : slot.parts) {
+                                DWORD written = 0;
+                                WriteConsoleA(out, p, static_cast<DWORD>(n), &written, nullptr);
+                            }
+                        #else
+                            iov.clear();
+                            for (auto& [p, n] : slot.parts) iov.push_back({ const_cast<char*>(p), n });
+                            writeAll(STDOUT_FILENO, iov.data(), int(iov.size()));
+                        #endif
+                    }
+
+                    CES_FrameSlot slots[SLOTS];
+                    int head = 0;               // Next slot to write
+                    int queued = 0;             // Submitted and not written yet (with the one being written)
+                    bool stop = false;
+                    mutex mtx;
+                    condition_variable cv;
+                    #if !defined(_WIN32)
+                        vector<iovec> iov;      // Only used by the writer thread
+                    #endif
+                    thread worker;              // Last, so everything above exists when it starts
+            };
+
+            // UTF-8 of every code point that was drawn, so the encoder only copies bytes.
+            // ASCII comes from a table; Everything else is added to a flat hash while merging (only the render thread does that)
+            // and the encoders of the bands only read it.
+            struct CES_GlyphCache {
+                struct Entry {
+                    char32_t key = 0;       // 0 = empty; ASCII never lands here
+                    CES_Glyph glyph;
+                };
+                vector<Entry> table;
+                size_t used = 0;
+
+                // Cells a code point takes on the screen: 0 (combining, joiners, ...), 1 or 2 (CJK, fullwidth, emoji).
+                // ! The ranges follow East Asian Width W/F and the emoji blocks, merged where it doesn't matter; Not the whole UCD.
+                static int displayWidth(char32_t c) noexcept {
+                    static constexpr CES_WidthRange ranges[] = {
+                        { 0x0300, 0x036F, 0 }, { 0x0483, 0x0489, 0 }, { 0x0591, 0x05BD, 0 }, { 0x05BF, 0x05BF, 0 },
+                        { 0x05C1, 0x05C2, 0 }, { 0x05C4, 0x05C5, 0 }, { 0x05C7, 0x05C7, 0 }, { 0x0610, 0x061A, 0 },
+                        { 0x064B, 0x065F, 0 }, { 0x0670, 0x0670, 0 }, { 0x06D6, 0x06DC, 0 }, { 0x06DF, 0x06E4, 0 },
+                        { 0x0E31, 0x0E31, 0 }, { 0x0E34, 0x0E3A, 0 }, { 0x0E47, 0x0E4E, 0 },
+                        { 0x1100, 0x115F, 2 }, { 0x1AB0, 0x1AFF, 0 }, { 0x1DC0, 0x1DFF, 0 },
+                        { 0x200B, 0x200F, 0 }, { 0x202A, 0x202E, 0 }, { 0x2060, 0x2064, 0 }, { 0x20D0, 0x20FF, 0 },
+                        { 0x231A, 0x231B, 2 }, { 0x2329, 0x232A, 2 }, { 0x23E9, 0x23EC, 2 }, { 0x23F0, 0x23F0, 2 },
+                        { 0x23F3, 0x23F3, 2 }, { 0x25FD, 0x25FE, 2 }, { 0x2614, 0x2615, 2 }, { 0x2648, 0x2653, 2 },
+                        { 0x267F, 0x267F, 2 }, { 0x2693, 0x2693, 2 }, { 0x26A1, 0x26A1, 2 }, { 0x26AA, 0x26AB, 2 },
+                        { 0x26BD, 0x26BE, 2 }, { 0x26C4, 0x26C5, 2 }, { 0x26CE, 0x26CE, 2 }, { 0x26D4, 0x26D4, 2 },
+                        { 0x26EA, 0x26EA, 2 }, { 0x26F2, 0x26F3, 2 }, { 0x26F5, 0x26F5, 2 }, { 0x26FA, 0x26FA, 2 },
+                        { 0x26FD, 0x26FD, 2 }, { 0x2705, 0x2705, 2 }, { 0x270A, 0x270B, 2 }, { 0x2728, 0x2728, 2 },
+                        { 0x274C, 0x274C, 2 }, { 0x274E, 0x274E, 2 }, { 0x2753, 0x2755, 2 }, { 0x2757, 0x2757, 2 },
+                        { 0x2795, 0x2797, 2 }, { 0x27B0, 0x27B0, 2 }, { 0x27BF, 0x27BF, 2 }, { 0x2B1B, 0x2B1C, 2 },
+                        { 0x2B50, 0x2B50, 2 }, { 0x2B55, 0x2B55, 2 }, { 0x2E80, 0x303E, 2 }, { 0x3041, 0x3096, 2 },
+                        { 0x3099, 0x309A, 0 }, { 0x309B, 0xA4CF, 2 }, { 0xA960, 0xA97F, 2 }, { 0xAC00, 0xD7A3, 2 },
+                        { 0xF900, 0xFAFF, 2 }, { 0xFE00, 0xFE0F, 0 }, { 0xFE10, 0xFE19, 2 }, { 0xFE20, 0xFE2F, 0 },
+                        { 0xFE30, 0xFE6F, 2 }, { 0xFEFF, 0xFEFF, 0 }, { 0xFF00, 0xFF60, 2 }, { 0xFFE0, 0xFFE6, 2 },
+                        { 0x16FE0, 0x16FE4, 2 }, { 0x17000, 0x18CFF, 2 }, { 0x1B000, 0x1B2FF, 2 }, { 0x1F004, 0x1F004, 2 },
+                        { 0x1F0CF, 0x1F0CF, 2 }, { 0x1F18E, 0x1F18E, 2 }, { 0x1F191, 0x1F19A, 2 }, { 0x1F200, 0x1F2FF, 2 },
+                        { 0x1F300, 0x1F64F, 2 }, { 0x1F680, 0x1F6FF, 2 }, { 0x1F900, 0x1F9FF, 2 }, { 0x1FA70, 0x1FAFF, 2 },
+                        { 0x20000, 0x2FFFD, 2 }, { 0x30000, 0x3FFFD, 2 }, { 0xE0000, 0xE007F, 0 }, { 0xE0100, 0xE01EF, 0 },
+                    };
+                    static_assert([] {
+                        for (size_t i = 1; i < size(ranges); i++) if (ranges[i - 1].last >= ranges[i].first) return false;
+                        return true;
+                    }(), "The width ranges have to be sorted and must not overlap");
+
+                    if (c < ranges[0].first) return 1;
+                    size_t lo = 0, hi = size(ranges);
+                    while (lo < hi) {
+                        size_t mid = (lo + hi) / 2;
+                        if (ranges[mid].last < c) lo = mid + 1;
+                        else hi = mid;
+                    }
+                    return (lo < size(ranges) && ranges[lo].first <= c) ? ranges[lo].width : 1;
+                }
+
+                // For a spot which is one cell wide (canvas and layer cells): A wide glyph would push the rest of the row, so it becomes '?'.
+                static inline char32_t oneCell(char32_t c) noexcept { return c >= 0x1100 && displayWidth(c) == 2 ? U'?' : c; }
+
+                static CES_Glyph encode(char32_t c) noexcept {
+                    CES_Glyph g;
+                    int w = displayWidth(c);
+                    if (w == 0) {
+                        // On a space, otherwise it would end up on the glyph of the cell to the left; If it doesn't fit, only the space stays.
+                        char tmp[4];
+                        int n = CES_AnsiEncoder::utf8(tmp, c);
+                        g.bytes[0] = ' ';
+                        if (n <= 3) memcpy(g.bytes + 1, tmp, n);
+                        g.len = uint8_t(n <= 3 ? n + 1 : 1);
+                        g.width = 1;
+                        return g;
+                    }
+                    g.len = uint8_t(CES_AnsiEncoder::utf8(g.bytes, c));
+                    g.width = uint8_t(w);
+                    return g;
+                }
+
+                // ! Control characters would move the cursor of the terminal, so they are drawn as a space.
+                static inline const CES_Glyph& ascii(char32_t c) noexcept {
+                    static constexpr array<CES_Glyph, 128> t = [] {
+                        array<CES_Glyph, 128> t{};
+                        for (int i = 0; i < 128; i++) {
+                            t[i].bytes[0] = (i < 0x20 || i == 0x7F) ? ' ' : char(i);
+                            t[i].len = 1;
+                            t[i].width = 1;
+                        }
+                        return t;
+                    }();
+                    return t[c];
+                }
+
+                static inline size_t slot(char32_t c, size_t mask) noexcept {
+                    uint32_t h = uint32_t(c) * 0x9E3779B1u;
+                    return (h ^ (h >> 16)) & mask;
+                }
+
+                CES_Glyph add(char32_t c) {
+                    if (c < 0x80) return ascii(c);
+                    if ((used + 1) * 2 > table.size()) grow();
+                    size_t mask = table.size() - 1;
+                    for (size_t i = slot(c, mask);; i = (i + 1) & mask) {
+                        if (table[i].key == c) return table[i].glyph;
+                        if (table[i].key == 0) {
+                            table[i] = { c, encode(c) };
+                            used++;
+                            return table[i].glyph;
+                        }
+                    }
+                }
+
+                inline CES_Glyph get(char32_t c) const noexcept {
+                    if (c < 0x80) return ascii(c);
+                    if (!table.empty()) {
+                        size_t mask = table.size() - 1;
+                        for (size_t i = slot(c, mask); table[i].key != 0; i = (i + 1) & mask) {
+                            if (table[i].key == c) return table[i].glyph;
+                        }
+                    }
+                    // Wasn't merged (a cell of 'frame' from before a resize, ...)
+                    return encode(c);
+                }
+
+                void grow() {
+                    vector<Entry> old(max<size_t>(64, table.size() * 2));
+                    old.swap(table);
+                    size_t mask = table.size() - 1;
+                    for (const Entry& e : old) {
+                        if (e.key == 0) continue;
+                        size_t i = slot(e.key, mask);
+                        while (table[i].key != 0) i = (i + 1) & mask;
+                        table[i] = e;
+                    }
+                }
+            };
+
+            // Knows where the cursor of the terminal really is and which color is set.
+            // For every jump it picks the cheapest way: CUP, CUF/CUB, CUU/CUD, CR+LF or printing the cells in between again.
+            struct alignas(64) CES_OutputPlanner {
+                const CES_Planes* frame = nullptr;
+                const CES_Planes* change = nullptr;
+                const CES_DirtyMap* damage = nullptr;
+                const CES_GlyphCache* glyphs = nullptr;
+                char32_t last_c = 0;        // The glyph looked up last; Lines and boxes repeat the same one
+                CES_Glyph last_g = CES_GlyphCache::ascii(0);
+                int width = 0;              // Width of the buffers
+                int cols = 0;               // Width of the terminal
+                int x_start = 0;            // Only cells in [x_start, x_end) may be printed again
+                int x_end = 0;
+
+                CES_ColorMode mode = CES_TRUECOLOR;
+                bool dither = false;
+                const CES_Palette* palette = nullptr;   // Only for 256 and 16 colors
+                int cx = -1;                // Cursor; -1 = unknown
+                int cy = -1;
+                bool known_fg = false;      // false = the color of the terminal is unknown
+                bool known_bg = false;
+                uint32_t fg = 0;            // Keys of the colors the terminal has; 'key()'
+                uint32_t bg = 0;
+
+                // Without 'd' every cell is taken from 'f'; 'start' is what the terminal has before the first byte of 'out'.
+                void begin(const CES_Planes& f, const CES_Planes& c, const CES_DirtyMap* d, const CES_GlyphCache& g, int w, int columns, int xs, int xe,
+                           CES_ColorMode m, bool dith, const CES_TermState& start) {
+                    frame = &f;
+                    change = &c;
+                    damage = d;
+                    glyphs = &g;
+                    width = w;
+                    cols = columns;
+                    x_start = xs;
+                    x_end = xe;
+                    mode = m;
+                    dither = dith;
+                    if (m != CES_TRUECOLOR) palette = &CES_Palette::get();
+                    cx = start.cx;
+                    cy = start.cy;
+                    known_fg = start.known_fg;
+                    known_bg = start.known_bg;
+                    fg = start.fg;
+                    bg = start.bg;
+                }
+
+                inline CES_TermState state() const noexcept { return { cx, cy, known_fg, known_bg, fg, bg }; }
+
+                // !
+                // ! What the terminal really gets for a color at (x, y): Colors with the same key look the same there; 0 = its default.
+                // ! With 256 or 16 colors it is the index of the nearest color (<< 8), which depends on (x, y) if it is dithered.
+                // !
+                inline uint32_t key(uint32_t rgba, int x, int y) const noexcept {
+                    if ((rgba & 0xFF) == 0) return 0;
+                    if (mode == CES_TRUECOLOR) return rgba | 0xFF;
+                    // The distance between two steps of the cube, or between dark and bright.
+                    int step = mode == CES_256COLOR ? 40 : 128;
+                    uint32_t i = CES_Palette::index(rgba, dither ? CES_Palette::dither(x, y, step) : 0);
+                    return uint32_t(mode == CES_256COLOR ? palette->to256[i] : palette->to16[i]) << 8 | 0xFF;
+                }
+                // A foreground is never transparent.
+                inline uint32_t fgKey(uint32_t rgba, int x, int y) const noexcept { return key(rgba | 0xFF, x, y); }
+
+                inline const CES_Glyph& glyph(char32_t c) noexcept {
+                    if (c != last_c) {
+                        last_c = c;
+                        last_g = glyphs->get(c);
+                    }
+                    return last_g;
+                }
+
+                static inline int digits(int v) noexcept { return v < 10 ? 1 : v < 100 ? 2 : v < 1000 ? 3 : 4; }
+                // ESC[yH is enough for the first column.
+                static inline int cupCost(int x, int y) noexcept { return x == 0 ? 3 + digits(y + 1) : 4 + digits(y + 1) + digits(x + 1); }
+                // ESC[nC, ESC[nD, ESC[nA, ESC[nB; 'n' can be left out if it is 1.
+                static inline int relCost(int n) noexcept { return n == 1 ? 3 : 3 + digits(n); }
+
+                static inline void rel(CES_ByteBuffer& out, int n, char cmd) {
+                    char* p = out.ensure(8);
+                    size_t i = 0;
+                    p[i++] = '\033'; p[i++] = '[';
+                    if (n != 1) CES_AnsiEncoder::number(p, i, CES_AnsiEncoder::dec_pos(min(n, 9999)));
+                    p[i++] = cmd;
+                    out.len += i;
+                }
+
+                // Which buffer holds what the terminal shows on this cell at the end of the frame.
+                inline const CES_Planes& shown(int x, int y) const noexcept {
+                    return damage && damage->isDirty(x, y) ? *change : *frame;
+                }
+
+                // How a pixel pair is printed: The glyph and the colors which have to be set.
+                struct PixelPick {
+                    const CES_Glyph* glyph;
+                    bool set_fg, set_bg;
+                    uint32_t fg, bg;        // Keys
+                };
+
+                // !
+                // ! Two pixels in one cell: '▀' with the upper one as foreground, '▄' with the lower one, a space or '█' if both are the same.
+                // ! Whichever needs the fewest colors to be changed, so a row of pixels mostly changes only one of them per cell.
+                // ! Transparent pixels (alpha 0) can only be the background. Dithered as pixels, not as cells.
+                // !
+                PixelPick pickPixels(uint32_t top, uint32_t bottom, int x, int y) const noexcept {
+                    static const CES_Glyph upper = CES_GlyphCache::encode(U'▀');
+                    static const CES_Glyph lower = CES_GlyphCache::encode(U'▄');
+                    static const CES_Glyph full = CES_GlyphCache::encode(U'█');
+                    uint32_t kt = key(top, x, 2 * y), kb = key(bottom, x, 2 * y + 1);
+
+                    // In the order they are preferred, if they cost the same.
+                    struct Option { const CES_Glyph* g; bool uses_fg, uses_bg; uint32_t fg, bg; } opts[2];
+                    int n = 0;
+                    if (kt == kb) {
+                        opts[n++] = { &CES_GlyphCache::ascii(U' '), false, true, 0, kt };
+                        if (kt) opts[n++] = { &full, true, false, kt, 0 };
+                    } else {
+                        if (kt) opts[n++] = { &upper, true, true, kt, kb };
+                        if (kb) opts[n++] = { &lower, true, true, kb, kt };
+                    }
+
+                    PixelPick best = {};
+                    int best_cost = INT_MAX;
+                    for (int k = 0; k < n; k++) {
+                        const Option& o = opts[k];
+                        bool set_fg = o.uses_fg && (!known_fg || fg != o.fg);
+                        bool set_bg = o.uses_bg && (!known_bg || bg != o.bg);
+                        int cost = set_fg + set_bg;
+                        if (cost < best_cost) {
+                            best_cost = cost;
+                            best = { o.g, set_fg, set_bg, o.fg, o.bg };
+                        }
+                    }
+                    return best;
+                }
+
+                // Bytes to print [from, to) of row 'y' again; INT_MAX if it is not possible or more than 'limit'.
+                // ! Wide glyphs are printed as a whole: Not from their right half and not if their right half is at 'to'.
+                int reprintCost(int from, int to, int y, int limit) const noexcept {
+                    if (from < x_start || to > x_end) return INT_MAX;
+                    if (shown(from, y).attr[size_t(y) * width + from] & CES_ATTR_CONT) return INT_MAX;
+                    int cost = 0;
+                    for (int x = from; x < to; x++) {
+                        const CES_Planes& p = shown(x, y);
+                        size_t i = size_t(y) * width + x;
+                        if (p.attr[i] & CES_ATTR_CONT) continue;
+                        if (p.attr[i] & CES_ATTR_PIXELS) {
+                            PixelPick pick = pickPixels(p.rgba[i], p.bg[i], x, y);
+                            if (pick.set_fg || pick.set_bg) return INT_MAX;
+                            cost += pick.glyph->len;
+                            if (cost > limit) return INT_MAX;
+                            continue;
+                        }
+                        if (!known_bg || key(p.bg[i], x, y) != bg) return INT_MAX;
+                        char32_t c = p.glyph[i];
+                        // A space (or a never used cell) looks the same in every foreground color.
+                        if (c == U'\0' || c == U' ') cost += 1;
+                        else if (known_fg && fgKey(p.rgba[i], x, y) == fg) {
+                            CES_Glyph g = glyphs->get(c);
+                            if (x + g.width > to) return INT_MAX;
+                            cost += g.len;
+                        }
+                        else return INT_MAX;
+                        if (cost > limit) return INT_MAX;
+                    }
+                    return cost;
+                }
+
+                void reprint(CES_ByteBuffer& out, int from, int to, int y) {
+                    for (int x = from; x < to; x++) {
+                        const CES_Planes& p = shown(x, y);
+                        size_t i = size_t(y) * width + x;
+                        if (p.attr[i] & CES_ATTR_PIXELS) CES_AnsiEncoder::glyph(out, *pickPixels(p.rgba[i], p.bg[i], x, y).glyph);
+                        else if (!(p.attr[i] & CES_ATTR_CONT)) CES_AnsiEncoder::glyph(out, glyph(p.glyph[i]));
+                    }
+                }
+
+                // Cost of moving from column 'from' to 'to' inside of row 'y'; If 'out' is set, the cheapest way is also written.
+                int horizontal(int from, int to, int y, CES_ByteBuffer* out) {
+                    if (from == to) return 0;
+                    if (to > from) {
+                        int cuf = relCost(to - from);
+                        int again = reprintCost(from, to, y, cuf - 1);
+                        if (out) {
+                            if (again < cuf) reprint(*out, from, to, y);
+                            else rel(*out, to - from, 'C');
+                        }
+                        return min(cuf, again);
+                    }
+                    int cub = relCost(from - to);
+                    int cr = 1 + horizontal(0, to, y, nullptr);
+                    if (out) {
+                        if (cr < cub) { out->put('\r'); horizontal(0, to, y, out); }
+                        else rel(*out, from - to, 'D');
+                    }
+                    return min(cub, cr);
+                }
+
+                void moveTo(CES_ByteBuffer& out, int x, int y) {
+                    if (cx == x && cy == y) return;
+
+                    enum { CUP, SAME_ROW, CRLF, DOWN, UP } how = CUP;
+                    int best = cupCost(x, y);
+
+                    if (cx >= 0 && cy >= 0) {
+                        if (cy == y) {
+                            int c = horizontal(cx, x, y, nullptr);
+                            if (c < best) { best = c; how = SAME_ROW; }
+                        } else if (y > cy) {
+                            int c = 1 + (y - cy) + horizontal(0, x, y, nullptr);
+                            if (c < best) { best = c; how = CRLF; }
+                            c = relCost(y - cy) + horizontal(cx, x, y, nullptr);
+                            if (c < best) { best = c; how = DOWN; }
+                        } else {
+                            int c = relCost(cy - y) + horizontal(cx, x, y, nullptr);
+                            if (c < best) { best = c; how = UP; }
+                        }
+                    }
+
+                    switch (how) {
+                        case CUP:
+                            CES_AnsiEncoder::cup(out, x, y);
+                            break;
+                        case SAME_ROW:
+                            horizontal(cx, x, y, &out);
+                            break;
+                        case CRLF:
+                            out.put('\r');
+                            for (int i = cy; i < y; i++) out.put('\n');
+                            horizontal(0, x, y, &out);
+                            break;
+                        case DOWN:
+                            rel(out, y - cy, 'B');
+                            horizontal(cx, x, y, &out);
+                            break;
+                        case UP:
+                            rel(out, cy - y, 'A');
+                            horizontal(cx, x, y, &out);
+                            break;
+                    }
+                    cx = x;
+                    cy = y;
+                }
+
+                // Only what is different from the colors the terminal has.
+                template <CES_ColorMode M>
+                inline void color(CES_ByteBuffer& out, uint32_t f, uint32_t b, int x, int y) {
+                    uint32_t kf = fgKey(f, x, y), kb = key(b, x, y);
+                    bool set_fg = !known_fg || fg != kf, set_bg = !known_bg || bg != kb;
+                    if (!set_fg && !set_bg) return;
+                    CES_AnsiEncoder::sgr<M>(out, set_fg, kf, set_bg, kb);
+                    fg = kf;
+                    bg = kb;
+                    known_fg = known_bg = true;
+                }
+
+                // Sets the colors for a pixel pair and returns the glyph which shows it.
+                template <CES_ColorMode M>
+                inline const CES_Glyph& pixels(CES_ByteBuffer& out, uint32_t top, uint32_t bottom, int x, int y) {
+                    PixelPick pick = pickPixels(top, bottom, x, y);
+                    if (pick.set_fg || pick.set_bg) CES_AnsiEncoder::sgr<M>(out, pick.set_fg, pick.fg, pick.set_bg, pick.bg);
+                    if (pick.set_fg) {
+                        fg = pick.fg;
+                        known_fg = true;
+                    }
+                    if (pick.set_bg) {
+                        bg = pick.bg;
+                        known_bg = true;
+                    }
+                    return *pick.glyph;
+                }
+
+                // After a glyph the cursor is 'n' cells further; In the last column the terminal waits for a wrap, so it is unknown.
+                inline void advance(int n = 1) noexcept {
+                    if ((cx += n) >= cols) cx = cy = -1;
+                }
+            };
+
+            // A whole row of cells with the same z; Its glyphs and colors are stored in the 'CES_Staging'.
+            struct CES_RowWrite {
+                int x, y, z;
+                uint32_t count;
+                size_t offset;          // Into 'row_glyph', 'row_rgba' and 'row_bg'
+                size_t after;           // 'cells.size()' when it was written; Keeps the order against single cells.
+                uint8_t attr = 0;       // Of every cell; CES_ATTR_PIXELS: A row of pixel pairs (upper in 'row_rgba', lower in 'row_bg')
+                bool canvas = false;    // Written by a canvas: Replaces what it drew before on the same z
+                size_t mask = SIZE_MAX; // Into 'row_mask': Only cells with 1 are written; SIZE_MAX = all of them
+            };
+
+            // Rows [top, bottom] moved by 'dy' (> 0: up).
+            struct CES_ScrollWrite {
+                int top, bottom, dy;
+                size_t after;           // Like 'CES_RowWrite::after'
+                size_t rows_before;     // 'rows.size()' when it was written; Keeps the order against the rows.
+            };
+
+            // Cells written by one producer thread since the last frame.
+            struct CES_Staging {
+                mutex mtx;              // Only the render thread competes for it, while swapping.
+                thread::id owner;
+                atomic<bool> ended{false};  // The owner thread is gone; Dropped after its last writes are merged
+                int order = INT_MAX;    // 'CES_Screen::setProducerOrder()'; Without one after every thread which has one
+                vector<CES_XY> cells;   // In the order they were written
+                vector<CES_RowWrite> rows;
+                vector<char32_t> row_glyph;
+                vector<uint32_t> row_rgba;
+                vector<uint32_t> row_bg;
+                vector<uint8_t> row_mask;   // Only for the rows of sprites ('CES_Screen::blit()')
+                vector<CES_ScrollWrite> scrolls;
+
+                void swapContent(CES_Staging& o) noexcept {
+                    cells.swap(o.cells);
+                    rows.swap(o.rows);
+                    scrolls.swap(o.scrolls);
+                    row_glyph.swap(o.row_glyph);
+                    row_rgba.swap(o.row_rgba);
+                    row_bg.swap(o.row_bg);
+                    row_mask.swap(o.row_mask);
+                }
+
+                // Writes waiting to be merged; Cells, cells of rows and scrolls.
+                size_t size() const noexcept { return cells.size() + row_glyph.size() + scrolls.size(); }
+
+                // Keeps the memory.
+                void clear() noexcept {
+                    cells.clear();
+                    rows.clear();
+                    scrolls.clear();
+                    row_glyph.clear();
+                    row_rgba.clear();
+                    row_bg.clear();
+                    row_mask.clear();
+                }
+            };
+
+            // The staging buffers of one thread, in every screen it wrote to; Marked when the thread ends, so the screens drop them.
+            struct CES_StagingOwner {
+                vector<shared_ptr<CES_Staging>> buffers;
+
+                ~CES_StagingOwner() {
+                    for (auto& st : buffers) st->ended.store(true, memory_order_release);
+                }
+            };
+
+            // !
+            // ! Pixels for the half block mode ('CES_Screen::drawPixels()'): Two rows of pixels make one row of cells.
+            // ! Packed like CES_COLOR::to_uint(), row by row; Alpha 0 is the background of the terminal.
+            // !
+            struct CES_PixelCanvas {
+                int width = 0;
+                int height = 0;             // Always even
+                vector<uint32_t> px;
+
+                CES_PixelCanvas(int w = 0, int h = 0) { resize(w, h); }
+
+                static constexpr uint32_t rgb(uint8_t r, uint8_t g, uint8_t b) noexcept {
+                    return (uint32_t(r) << 24) | (uint32_t(g) << 16) | (uint32_t(b) << 8) | 0xFF;
+                }
+
+                void resize(int w, int h) {
+                    width = max(w, 0);
+                    height = max(h, 0) + (h & 1);
+                    px.assign(size_t(width) * height, 0);
+                }
+
+                inline void set(int x, int y, uint32_t rgba) noexcept {
+                    if (x < 0 || y < 0 || x >= width || y >= height) return;
+                    px[size_t(y) * width + x] = rgba;
+                }
+                inline void set(int x, int y, const CES_COLOR& c) noexcept { set(x, y, c.to_uint()); }
+
+                inline uint32_t get(int x, int y) const noexcept {
+                    if (x < 0 || y < 0 || x >= width || y >= height) return 0;
+                    return px[size_t(y) * width + x];
+                }
+
+                void fill(uint32_t rgba) noexcept { std::fill(px.begin(), px.end(), rgba); }
+
+                inline uint32_t* row(int y) noexcept { return px.data() + size_t(y) * width; }
+                inline const uint32_t* row(int y) const noexcept { return px.data() + size_t(y) * width; }
+            };
+
+            // !
+            // ! Dots for the Braille mode ('CES_Screen::drawBraille()'): A cell is one of the 256 patterns from U+2800, 2 x 4 dots.
+            // ! One bit per dot, row by row, so a span is an OR of whole words; Cells whose dots changed are remembered
+            // ! until they are drawn.
+            // !
+            struct CES_BrailleCanvas {
+                int cols = 0, rows = 0;         // In cells
+                int width = 0, height = 0;      // In dots
+                size_t words = 0;               // Per row of dots
+                size_t cell_words = 0;          // Per row of cells in 'dirty'
+                vector<uint64_t> bits;
+                vector<uint64_t> dirty;         // One bit per cell
+
+                CES_BrailleCanvas(int c = 0, int r = 0) { resize(c, r); }
+
+                void resize(int c, int r) {
+                    cols = max(c, 0);
+                    rows = max(r, 0);
+                    width = cols * 2;
+                    height = rows * 4;
+                    words = (size_t(width) + 63) / 64;
+                    cell_words = (size_t(cols) + 63) / 64;
+                    bits.assign(words * height, 0);
+                    dirty.assign(cell_words * rows, 0);
+                    redraw();
+                }
+
+                // Every cell is drawn again the next time; After something else covered the canvas or with a new color.
+                void redraw() noexcept {
+                    for (int r = 0; r < rows; r++) markCells(r, 0, cols - 1);
+                }
+
+                // Every dot off.
+                void clear() noexcept {
+                    fill(bits.begin(), bits.end(), 0);
+                    redraw();
+                }
+
+                inline void plot(int x, int y, bool on = true) noexcept {
+                    if (x < 0 || y < 0 || x >= width || y >= height) return;
+                    uint64_t& w = bits[size_t(y) * words + (x >> 6)];
+                    uint64_t b = uint64_t(1) << (x & 63);
+                    if (((w & b) != 0) == on) return;
+                    w ^= b;
+                    dirty[size_t(y >> 2) * cell_words + (x >> 7)] |= uint64_t(1) << ((x >> 1) & 63);
+                }
+
+                inline bool get(int x, int y) const noexcept {
+                    if (x < 0 || y < 0 || x >= width || y >= height) return false;
+                    return bits[size_t(y) * words + (x >> 6)] >> (x & 63) & 1;
+                }
 
-            bool fullEquals(const CES_XY& other) const noexcept {
-                return x == other.x && y == other.y
-                    && ARGB == other.ARGB && c == other.c && z == other.z;
-            }
+                // Every dot of [x0, x1] (inclusive) in row 'y'.
+                void span(int y, int x0, int x1) noexcept {
+                    if (x0 > x1) swap(x0, x1);
+                    x0 = max(x0, 0);
+                    x1 = min(x1, width - 1);
+                    if (y < 0 || y >= height || x0 > x1) return;
+                    orBits(&bits[size_t(y) * words], x0, x1);
+                    markCells(y >> 2, x0 >> 1, x1 >> 1);
+                }
 
-            struct CES_XY_Hash {
-                size_t operator()(const CES_XY& v) const noexcept {
-                    size_t h = 0;
+                // Bresenham; The steps inside of one row are ORed as a span.
+                void line(int x0, int y0, int x1, int y1) noexcept {
+                    int dx = abs(x1 - x0), dy = abs(y1 - y0);
+                    int sx = (x0 < x1) ? 1 : -1;
+                    int sy = (y0 < y1) ? 1 : -1;
+                    int err = dx - dy;
+                    int run = x0;
+                    while (x0 != x1 || y0 != y1) {
+                        int e2 = 2 * err, last = x0;
+                        if (e2 > -dy) { err -= dy; x0 += sx; }
+                        if (e2 < dx) {
+                            span(y0, run, last);
+                            err += dx;
+                            y0 += sy;
+                            run = x0;
+                        }
+                    }
+                    span(y0, run, x0);
+                }
 
-                    auto mix = [&h](size_t x) {
-                        h ^= x + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+                // The pattern of a cell: Bits 0-2 and 6 are the left column from the top, 3-5 and 7 the right one.
+                inline uint8_t cellMask(int cx, int cy) const noexcept {
+                    static constexpr uint8_t dots[4][4] = {
+                        { 0, 0x01, 0x08, 0x09 }, { 0, 0x02, 0x10, 0x12 }, { 0, 0x04, 0x20, 0x24 }, { 0, 0x40, 0x80, 0xC0 },
                     };
+                    int x = cx * 2;
+                    uint8_t m = 0;
+                    // Both dots of a cell are in the same word, since 'x' is even.
+                    for (int r = 0; r < 4; r++) m |= dots[r][bits[(size_t(cy) * 4 + r) * words + (x >> 6)] >> (x & 63) & 3];
+                    return m;
+                }
 
-                    mix(static_cast<size_t>(v.x));
-                    mix(static_cast<size_t>(v.y));
-                    mix(static_cast<size_t>(v.z));
-                    mix(static_cast<size_t>(v.ARGB.to_uint()));
-                    mix(static_cast<size_t>(v.c));
+                static inline void orBits(uint64_t* row, int x0, int x1) noexcept {
+                    int w0 = x0 >> 6, w1 = x1 >> 6;
+                    uint64_t first = ~uint64_t(0) << (x0 & 63);
+                    uint64_t last = ~uint64_t(0) >> (63 - (x1 & 63));
+                    if (w0 == w1) {
+                        row[w0] |= first & last;
+                        return;
+                    }
+                    row[w0] |= first;
+                    for (int w = w0 + 1; w < w1; w++) row[w] = ~uint64_t(0);
+                    row[w1] |= last;
+                }
 
-                    return h;
+                inline void markCells(int cy, int c0, int c1) noexcept {
+                    if (c0 > c1) return;
+                    orBits(&dirty[size_t(cy) * cell_words], c0, c1);
                 }
             };
 
-            struct PairHash {
-                size_t operator()(const pair<int, int>& p) const noexcept {
-                    return (static_cast<size_t>(p.first) << 16) | p.second;
+            // !
+            // ! The colors of packed cells ('CES_Cell'): Every pair of foreground and background gets an index the first time it is used.
+            // ! Index 0 is white on the background of the terminal. It never shrinks; A scene has far less pairs than cells.
+            // !
+            struct CES_ColorTable {
+                vector<uint64_t> pairs;                     // fg << 32 | bg, both as CES_COLOR::to_uint()
+                unordered_map<uint64_t, uint32_t> index;
+
+                CES_ColorTable() { intern(0xFFFFFFFF, 0); }
+
+                uint32_t intern(uint32_t fg, uint32_t bg) {
+                    uint64_t pair = uint64_t(fg) << 32 | bg;
+                    auto [it, added] = index.try_emplace(pair, uint32_t(pairs.size()));
+                    if (added) pairs.push_back(pair);
+                    return it->second;
                 }
+                inline uint32_t intern(const CES_COLOR& fg, const CES_COLOR& bg) { return intern(fg.to_uint(), bg.to_uint()); }
+
+                inline uint32_t fg(uint32_t i) const noexcept { return uint32_t(pairs[i] >> 32); }
+                inline uint32_t bg(uint32_t i) const noexcept { return uint32_t(pairs[i]); }
             };
 
-            struct VecHash {
-                size_t operator()(const vector<CES_XY>& v) const noexcept {
-                    size_t h = 0;
-                    CES_XY_Hash hasher;
+            // !
+            // ! One cell in 8 bytes: 21 bits codepoint, 8 bits 'CES_CellAttr' (3 bits left) and the index of its colors in a 'CES_ColorTable'.
+            // ! Two cells are the same if their 64 bits are, so comparing them is one instruction.
+            // !
+            struct CES_Cell {
+                uint64_t v = 0;
 
-                    for (const auto& p : v) {
-                        h ^= hasher(p)
-                        + 0x9e3779b97f4a7c15ULL
-                        + (h << 6)
-                        + (h >> 2);
+                constexpr CES_Cell() noexcept = default;
+                constexpr CES_Cell(char32_t c, uint32_t colors, uint8_t attr = 0) noexcept
+                    : v(uint64_t(colors) << 32 | uint64_t(attr) << 21 | (uint32_t(c) & 0x1FFFFF)) {}
+
+                constexpr char32_t glyph() const noexcept { return char32_t(v & 0x1FFFFF); }
+                constexpr uint8_t attr() const noexcept { return uint8_t(v >> 21); }
+                constexpr uint32_t colors() const noexcept { return uint32_t(v >> 32); }
+
+                constexpr bool operator==(const CES_Cell& o) const noexcept { return v == o.v; }
+            };
+            static_assert(sizeof(CES_Cell) == 8);
+
+            // !
+            // ! A grid of packed cells, as big as it has to be (a map, a document, ...); 'CES_Screen::drawCells()' shows a part of it.
+            // ! 8 bytes per cell plus every color pair once: 480 x 270 cells (a 4K screen in 8 x 8 fonts) are about 1 MB.
+            // ! Only glyphs which are one cell wide: 'set()' makes wide ones a '?'. For wide glyphs there is 'writeRow()'.
+            // !
+            struct CES_CellCanvas {
+                // Which part was drawn where the last time; Anything else draws every cell again.
+                struct View {
+                    int cx = 0, cy = 0, x = 0, y = 0, w = 0, h = 0, z = 0;
+                    bool operator==(const View&) const noexcept = default;
+                };
+
+                int width = 0, height = 0;
+                size_t words = 0;               // Per row in 'dirty'
+                vector<CES_Cell> cells;         // Written through 'set()'
+                vector<uint64_t> dirty;         // One bit per cell; Changed since it was drawn
+                CES_ColorTable colors;
+                View view = { INT_MIN };
+
+                CES_CellCanvas(int w = 0, int h = 0) { resize(w, h); }
+
+                // Every cell becomes an empty one: A space, white on the background of the terminal.
+                void resize(int w, int h) {
+                    width = max(w, 0);
+                    height = max(h, 0);
+                    words = (size_t(width) + 63) / 64;
+                    cells.assign(size_t(width) * height, CES_Cell(U' ', 0));
+                    dirty.assign(words * height, 0);
+                    redraw();
+                }
+
+                // Every cell is drawn again the next time; After something else covered the canvas.
+                void redraw() noexcept {
+                    for (int y = 0; y < height; y++) {
+                        if (width) CES_BrailleCanvas::orBits(&dirty[size_t(y) * words], 0, width - 1);
                     }
-                    return h;
                 }
-            };
 
-            struct VecPtrHash
-            {
-                size_t operator()(const vector<CES::CES_XY>* v) const noexcept
-                {
-                    return hash<const void*>{}(v);
+                inline void set(int x, int y, CES_Cell c) noexcept {
+                    if (x < 0 || y < 0 || x >= width || y >= height) return;
+                    if (c.glyph() >= 0x1100) c = CES_Cell(CES_GlyphCache::oneCell(c.glyph()), c.colors(), c.attr());
+                    CES_Cell& old = cells[size_t(y) * width + x];
+                    if (old == c) return;
+                    old = c;
+                    dirty[size_t(y) * words + (x >> 6)] |= uint64_t(1) << (x & 63);
+                }
+                inline void set(int x, int y, char32_t c, const CES_COLOR& fg, const CES_COLOR& bg = CES_COLOR(0, 0, 0, 0), uint8_t attr = 0) {
+                    set(x, y, CES_Cell(c, colors.intern(fg, bg), attr));
                 }
-            };
 
+                inline CES_Cell get(int x, int y) const noexcept {
+                    if (x < 0 || y < 0 || x >= width || y >= height) return CES_Cell(U' ', 0);
+                    return cells[size_t(y) * width + x];
+                }
 
+                void fill(CES_Cell c) noexcept {
+                    for (int y = 0; y < height; y++) {
+                        for (int x = 0; x < width; x++) set(x, y, c);
+                    }
+                }
 
-            string convertCHAR32toCHAR(char32_t c) const
-            {
-                string out;
+                inline const CES_Cell* row(int y) const noexcept { return cells.data() + size_t(y) * width; }
 
-                if (c <= 0x7F) {
-                    out.push_back(static_cast<char>(c));
+                inline bool isDirty(int x, int y) const noexcept { return dirty[size_t(y) * words + (x >> 6)] >> (x & 63) & 1; }
+
+                // [x0, x1) of row 'y' was drawn.
+                void clean(int y, int x0, int x1) noexcept {
+                    uint64_t* d = &dirty[size_t(y) * words];
+                    for (int x = x0; x < x1; ) {
+                        int n = min(64 - (x & 63), x1 - x);
+                        d[x >> 6] &= ~((n == 64 ? ~uint64_t(0) : (uint64_t(1) << n) - 1) << (x & 63));
+                        x += n;
+                    }
                 }
-                else if (c <= 0x7FF) {
-                    out.push_back(static_cast<char>(0xC0 | ((c >> 6) & 0x1F)));
-                    out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            };
+
+            // Flags of 'CES_Screen::blit()'.
+            enum CES_BlitFlags : uint8_t {
+                CES_BLIT_FLIP_H = 0x01,     // Mirrored from left to right (the cells, not the glyphs)
+                CES_BLIT_FLIP_V = 0x02,     // Upside down
+                CES_BLIT_KEY = 0x04         // Cells with the glyph 'CES_SpriteAtlas::key' are transparent too
+            };
+
+            struct CES_SpriteAtlas;
+
+            // A part of a 'CES_SpriteAtlas' ('add()'); Cheap to copy, the cells stay in the atlas.
+            struct CES_Sprite {
+                CES_SpriteAtlas* atlas = nullptr;
+                int x = 0, y = 0;               // In the atlas
+                int width = 0, height = 0;
+
+                // Index of a cell in the atlas.
+                size_t at(int cx, int cy) const noexcept { return size_t(y + cy) * atlas->width + x + cx; }
+
+                void set(int cx, int cy, char32_t c, const CES_COLOR& fg, const CES_COLOR& bg = CES_COLOR(0, 0, 0, 0)) noexcept {
+                    if (cx < 0 || cy < 0 || cx >= width || cy >= height) return;
+                    size_t i = at(cx, cy);
+                    atlas->glyph[i] = c;
+                    atlas->rgba[i] = fg.to_uint();
+                    atlas->bg[i] = bg.to_uint();
+                    atlas->mask[i] = 1;
+                    // A wide glyph covers the next cell too.
+                    if (c >= 0x1100 && CES_GlyphCache::displayWidth(c) == 2) erase(cx + 1, cy);
                 }
-                else if (c <= 0xFFFF) {
-                    out.push_back(static_cast<char>(0xE0 | ((c >> 12) & 0x0F)));
-                    out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
-                    out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+
+                // Transparent again.
+                void erase(int cx, int cy) noexcept {
+                    if (cx < 0 || cy < 0 || cx >= width || cy >= height) return;
+                    atlas->mask[at(cx, cy)] = 0;
                 }
-                else if (c <= 0x10FFFF) {
-                    out.push_back(static_cast<char>(0xF0 | ((c >> 18) & 0x07)));
-                    out.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
-                    out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
-                    out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+
+                // One string per row, from the top, all in the same colors; Spaces stay transparent, a wide glyph takes two cells.
+                void draw(initializer_list<u32string_view> rows, const CES_COLOR& fg, const CES_COLOR& bg = CES_COLOR(0, 0, 0, 0)) noexcept {
+                    int cy = 0;
+                    for (u32string_view row : rows) {
+                        int cx = 0;
+                        for (char32_t c : row) {
+                            if (c != U' ') set(cx, cy, c, fg, bg);
+                            cx += c >= 0x1100 ? max(CES_GlyphCache::displayWidth(c), 1) : 1;
+                        }
+                        cy++;
+                    }
                 }
-                else {
-                    out = "\xEF\xBF\xBD";
+            };
+
+            // !
+            // ! The cells of many sprites in one grid, placed on shelves (rows of sprites next to each other);
+            // ! Every row of a sprite is contiguous, so 'CES_Screen::blit()' copies it as a whole. 'mask' is 1 for cells which are drawn.
+            // !
+            struct CES_SpriteAtlas {
+                int width = 0, height = 0;
+                vector<char32_t> glyph;
+                vector<uint32_t> rgba;
+                vector<uint32_t> bg;
+                vector<uint8_t> mask;
+                char32_t key = U' ';            // For CES_BLIT_KEY
+                int shelf_x = 0, shelf_y = 0, shelf_h = 0;
+
+                explicit CES_SpriteAtlas(int w = 256) : width(max(w, 1)) {}
+
+                // Room for a sprite of w x h, every cell transparent; A sprite wider than the atlas makes it wider.
+                CES_Sprite add(int w, int h) {
+                    w = max(w, 0);
+                    h = max(h, 0);
+                    if (w > width) widen(w);
+                    if (shelf_x + w > width) {
+                        shelf_y += shelf_h;
+                        shelf_x = shelf_h = 0;
+                    }
+                    CES_Sprite s{ this, shelf_x, shelf_y, w, h };
+                    shelf_x += w;
+                    shelf_h = max(shelf_h, h);
+                    if (shelf_y + shelf_h > height) {
+                        height = shelf_y + shelf_h;
+                        size_t n = size_t(width) * height;
+                        glyph.resize(n, U' ');
+                        rgba.resize(n, CES_COLOR().to_uint());
+                        bg.resize(n, 0);
+                        mask.resize(n, 0);
+                    }
+                    return s;
                 }
 
-                return out;
-            }
+                private:
+                    // The sprites only know their position, so moving the rows doesn't break them.
+                    void widen(int w) {
+                        auto restride = [&](auto& v, auto fill) {
+                            auto old = move(v);
+                            v.assign(size_t(w) * height, fill);
+                            for (int r = 0; r < height; r++) copy_n(old.begin() + size_t(r) * width, width, v.begin() + size_t(r) * w);
+                        };
+                        restride(glyph, U' ');
+                        restride(rgba, CES_COLOR().to_uint());
+                        restride(bg, 0u);
+                        restride(mask, uint8_t(0));
+                        width = w;
+                    }
+            };
 
-        };
+            // !
+            // ! A named layer of the screen ('CES_Screen::addLayer()'): Its own sparse cells and the positions which changed since the last frame.
+            // ! Only those positions are resolved at frame time, top-down through the visible layers.
+            // !
+            struct CES_Layer {
+                string name;
+                int z = 0;
+                bool visible = true;
+                unordered_map<uint64_t, CES_Cell> cells;    // By 'key()'; Outside of the screen too
+                CES_ColorTable colors;
+                vector<uint64_t> dirty;                     // Keys; Twice doesn't hurt
+                mutex mtx;                                  // A producer writes into one layer, the compositor reads all of them
+
+                static constexpr uint64_t key(int x, int y) noexcept { return uint64_t(uint32_t(y)) << 32 | uint32_t(x); }
+                static constexpr int keyX(uint64_t k) noexcept { return int(uint32_t(k)); }
+                static constexpr int keyY(uint64_t k) noexcept { return int(uint32_t(k >> 32)); }
+
+                // Every cell is resolved again; After the layer was shown, hidden or moved to another z.
+                void markAll() {
+                    for (const auto& [k, c] : cells) dirty.push_back(k);
+                }
+            };
 
-        struct TerminalCapabilities {
-            int supportsColor = 1;
-            bool supportsRGB = false;
-            bool supportsCursor = false;
-            bool supportsMouse = false;
-        };
+            // Defined in the 'CES_THREAD_POOL'-Unit, which is opened by the 'CES_Screen'.
+            class ThreadPool;
 
-        #ifdef CES_CELL_SYSTEM
             class CES_Screen {
                 public:
                     // Finding the Terminal:
@@ -385,9 +2054,10 @@ class CES {
                             // Color and RGB
                             const char* term = getenv("TERM");
                             const char* colorterm = getenv("COLORTERM");
-                            if (colorterm && string(colorterm) == "truecolor") { supported.supportsColor = 0xFFFFFF; supported.supportsRGB = true; }
-                            if (string(term).find("256color") != string::npos) supported.supportsColor = 256;
+                            // Weakest first, so the best detected form stays.
                             if (term) supported.supportsColor = 16;
+                            if (term && string(term).find("256color") != string::npos) supported.supportsColor = 256;
+                            if (colorterm && (string(colorterm) == "truecolor" || string(colorterm) == "24bit")) { supported.supportsColor = 0xFFFFFF; supported.supportsRGB = true; }
 
                             // Mouse support
                             termios oldt, newt;
@@ -415,20 +2085,63 @@ class CES {
                             fcntl(STDIN_FILENO, F_SETFL, flags);
 
                             if (n > 0) supported.supportsMouse = true;
+
+                            supported.supportsSyncOutput = probeSyncOutput();
                         #endif
 
+                        if (supported.supportsRGB) color_mode = CES_TRUECOLOR;
+                        else if (supported.supportsColor >= 256) color_mode = CES_256COLOR;
+                        else color_mode = CES_16COLOR;
+
                         // Bringing the terminal in a constant state of no scrolling
                         cout << "\033[?1049h";
+                        // ! The frames don't go through 'cout', so it has to be empty before the first one.
+                        cout.flush();
+
+                        // Nothing is pending: 'change' starts below every z index.
+                        change.assign(size_t(height)*width, INT_MIN);
+                        frame.assign(size_t(height)*width, 0);
+                        damage.resize(width, height);
+                        resetTiles();
+
+                        #if !defined(_WIN32)
+                            // SIGWINCH only bumps a counter; The screen looks at it once per frame.
+                            // ! Installed by the first screen, the handler of the application is called after it and comes back with the last screen.
+                            {
+                                lock_guard<mutex> lock(winch_mtx);
+                                if (winch_screens++ == 0) {
+                                    struct sigaction sa = {};
+                                    sa.sa_sigaction = onWinch;
+                                    sigemptyset(&sa.sa_mask);
+                                    sa.sa_flags = SA_RESTART | SA_SIGINFO;
+                                    sigaction(SIGWINCH, &sa, &old_winch);
+                                }
+                            }
+                            seen_resize = resize_generation.load(memory_order_relaxed);
+                            // A resize before the handler was there would be lost otherwise.
+                            pair<int, int> now = WidthHeight();
+                            if (now.first != width || now.second != height) resize(now.first, now.second);
+                        #endif
 
-                        change.resize(height*width);
-                        frame.resize(height*width);
+                        // One worker per core; The pool lives as long as the screen does.
+                        render_pool = make_unique<ThreadPool>(max(1u, thread::hardware_concurrency()));
+                        writer = make_unique<CES_FrameWriter>();
                     }
 
                     ~CES_Screen() {
+                        // Everything that is queued goes out first, 'cout' comes after it.
+                        writer.reset();
+                        // The frames leave the colors of their last cell.
+                        cout << "\033[0m";
                         // Moving out from this specific terminal setting
                         cout << "\033[?1049l";
                         ClearConsole();
                         cout << "\033[1;1H";
+
+                        #if !defined(_WIN32)
+                            lock_guard<mutex> lock(winch_mtx);
+                            if (--winch_screens == 0) sigaction(SIGWINCH, &old_winch, nullptr);
+                        #endif
                     }
 
                     /*void OutputCurWindow() {
@@ -692,283 +2405,1252 @@ class CES {
     std::ofstream("Debug.txt") << "Ja\n";
 }
 
-                        #if defined(_WIN32)
-                            DWORD written = 0;
-                            WriteConsoleA(
-                                hOut,
-                                framebuffer.data(),
-                                static_cast<DWORD>(framebuffer.size()),
-                                &written,
-                                nullptr
-                            );
-                        #else
-                            write(STDOUT_FILENO, framebuffer.data(), framebuffer.size());
-                        #endif
+                        #if defined(_WIN32)
+                            DWORD written = 0;
+                            WriteConsoleA(
+                                hOut,
+                                framebuffer.data(),
+                                static_cast<DWORD>(framebuffer.size()),
+                                &written,
+                                nullptr
+                            );
+                        #else
+                            write(STDOUT_FILENO, framebuffer.data(), framebuffer.size());
+                        #endif
+
+                        // ! Needs to be cleared.
+                        change.clear();
+                        erase_frame.clear();
+                        frame.insert(thread_0.begin(), thread_0.end());
+                        frame.insert(thread_1.begin(), thread_1.end());
+                        frame.insert(thread_2.begin(), thread_2.end());
+                        frame.insert(thread_3.begin(), thread_3.end());
+
+                        lock_all.unlock();  // <-- Lock from the start of this function
+                    }*/
+
+                    void OutputCurWindow() {
+                        // Blocking every thread to write anything else
+                        unique_lock<mutex> lock_all(mtx_write);
+
+                        // The buffers always have the size of the terminal; No ioctl unless it was resized.
+                        pollResize();
+                        mergeStagings();
+
+                        // The terminal is still busy with the frames before: Nothing is encoded, the damage goes out with the next frame.
+                        CES_FrameSlot* slot = writer->acquire();
+                        if (!slot) {
+                            stats.skipped++;
+                            return;
+                        }
+
+                        int x = width;
+                        int y = height;
+
+                        // !
+                        // ! The screen is split into horizontal bands, with about the same amount of dirty cells in each of them.
+                        // ! The amount of bands follows the damage: Small frames are rendered right here without any thread.
+                        // !
+                        row_dirty.assign(y, 0);
+                        size_t total = 0;
+                        damage.forEachRow(0, y, [&](int r) {
+                            row_dirty[r] = damage.countRow(r, 0, x);
+                            total += row_dirty[r];
+                        });
+
+                        int k = int(min<size_t>(total / CES_BAND_MIN_CELLS, render_pool->size()));
+                        k = max(k, 1);
+
+                        // band[i] is the first row of band i; band[k] is the end.
+                        bands.assign(k + 1, y);
+                        bands[0] = 0;
+                        size_t acc = 0;
+                        int b = 1;
+                        for (int r = 0; r < y && b < k; r++) {
+                            acc += row_dirty[r];
+                            if (acc * k >= total * b) bands[b++] = r + 1;
+                        }
+
+                        // Hide Cursor
+                        static const char hide_cursor[] = "\033[?25l";
+                        // After a resize the terminal has reflowed the old content; It is cleared and everything is drawn again.
+                        static const char clear_screen[] = "\033[0m\033[2J";
+                        // Begin/End of a synchronized update; The terminal shows the frame at once, or after its own timeout.
+                        static const char sync_begin[] = "\033[?2026h";
+                        static const char sync_end[] = "\033[?2026l";
+
+                        // What the terminal has before the first band; The cursor and colors of the last frame, unless something came in between.
+                        CES_TermState at = term;
+
+                        // The whole screen from the tile cache; The terminal is cleared before, so the scrolling is part of it already.
+                        if (repaint) {
+                            scroll_ops.clear();
+                            // SGR 0: The default background, no known foreground; ED keeps the cursor.
+                            at.known_fg = false;
+                            at.known_bg = true;
+                            at.bg = 0;
+                            repaintTiles(slot->head, x, at);
+                        }
+
+                        // Scrolling comes before every cell; The rows which come in are blank in the default colors.
+                        if (!scroll_ops.empty()) {
+                            CES_AnsiEncoder::reset(slot->head);
+                            for (const auto& op : scroll_ops) CES_AnsiEncoder::scroll(slot->head, op.top, op.bottom, op.dy);
+                            slot->head.put("\033[r", 3);
+                            scroll_ops.clear();
+                            // DECSTBM moves the cursor home.
+                            at = CES_TermState();
+                            at.cx = at.cy = 0;
+                            at.known_bg = true;
+                        }
+
+                        // Every band writes into its own buffer of the slot.
+                        // ! The buffers belong to the writer, so they keep their memory from the last frames.
+                        if (int(slot->tiles.size()) < k) slot->tiles.resize(k);
+                        if (int(tile_plan.size()) < k) tile_plan.resize(k);
+                        vector<CES_ByteBuffer>& tile_out = slot->tiles;
+
+                        auto encodeBand = [this, x, &tile_out, &at](int t) {
+                            const CES_TermState start = t == 0 ? at : CES_TermState();
+                            // The color form is decided here once, not for every cell.
+                            switch (color_mode) {
+                                case CES_TRUECOLOR: encodeTile<CES_TRUECOLOR>(0, bands[t], x, bands[t+1], x, tile_out[t], tile_plan[t], start); break;
+                                case CES_256COLOR:  encodeTile<CES_256COLOR>(0, bands[t], x, bands[t+1], x, tile_out[t], tile_plan[t], start); break;
+                                case CES_16COLOR:   encodeTile<CES_16COLOR>(0, bands[t], x, bands[t+1], x, tile_out[t], tile_plan[t], start); break;
+                            }
+                        };
+
+                        try {
+                            runBands(k, encodeBand);
+                        } catch (...) {
+                            // Nothing of this frame is sent and the damage stays. The scrolls are in 'frame' already, so the next frame draws everything again.
+                            repaint = true;
+                            throw;
+                        }
+
+                        // The bands are handed to the terminal as they are; No copy into one big string.
+                        bool sync = supported.supportsSyncOutput && (repaint || !slot->head.empty() || any_of(tile_out.begin(), tile_out.begin() + k, [](const CES_ByteBuffer& b) { return !b.empty(); }));
+                        if (sync) slot->add(sync_begin, sizeof(sync_begin) - 1);
+                        if (repaint) slot->add(clear_screen, sizeof(clear_screen) - 1);
+                        if (!slot->head.empty()) slot->add(slot->head.data(), slot->head.size());
+                        for (int t = 0; t < k; t++) {
+                            if (!tile_out[t].empty()) slot->add(tile_out[t].data(), tile_out[t].size());
+                        }
+                        // Once is enough, unless the terminal may have been reset.
+                        if (!cursor_hidden || repaint) slot->add(hide_cursor, sizeof(hide_cursor) - 1);
+                        cursor_hidden = true;
+                        if (sync) slot->add(sync_end, sizeof(sync_end) - 1);
+                        size_t bytes = slot->bytes;
+                        writer->submit();
+
+                        // The next frame goes on from the last band which wrote anything.
+                        term = at;
+                        for (int t = k - 1; t >= 0; t--) {
+                            if (!tile_out[t].empty()) {
+                                term = tile_plan[t].state();
+                                break;
+                            }
+                        }
+
+                        repaint = false;
+                        stats.frames++;
+                        stats.bytes = bytes;
+                        stats.total_bytes += bytes;
+
+                        // The changes are on their way to the terminal, so they are part of the current frame.
+                        // ! 'change' needs to be cleared afterwards.
+                        damage.forEachRow(0, height, [this](int y) {
+                            damage.forEachInRow(y, 0, width, [this, y](int x) {
+                                size_t i = size_t(y) * width + x;
+                                uint64_t& h = tileHash(x, y);
+                                h ^= cellHash(x, y, i);
+                                frame.copy(i, change, i);
+                                h ^= cellHash(x, y, i);
+                                change.depth[i] = INT_MIN;
+                                change.attr[i] = 0;
+                            });
+                        });
+                        damage.clear();
+
+                        lock_all.unlock();  // <-- Lock from the start of this function
+                    }
+
+                    // !
+                    // ! Runs 'job(0)' ... 'job(k - 1)' on the render pool and waits for all of them; With k == 1 on this thread.
+                    // ! The pool is owned by the screen, so a frame only hands out jobs instead of creating threads. A job which throws
+                    // ! still counts down 'done', and the first exception is rethrown after every job ended.
+                    // !
+                    template <class Job>
+                    void runBands(int k, Job& job) {
+                        if (k == 1) {
+                            job(0);
+                            return;
+                        }
+                        // Counted down by every job; The calling thread sleeps on it instead of polling.
+                        latch done(k);
+                        mutex failed_mtx;
+                        exception_ptr failed;
+                        for (int t = 0; t < k; t++) {
+                            render_pool->enqueue([&job, &done, &failed_mtx, &failed, t]() {
+                                try {
+                                    job(t);
+                                } catch (...) {
+                                    lock_guard<mutex> lock(failed_mtx);
+                                    if (!failed) failed = current_exception();
+                                }
+                                done.count_down();
+                            });
+                        }
+                        done.wait();
+                        if (failed) rethrow_exception(failed);
+                    }
+
+                    // Encodes every changed cell inside of the area [x_start, x_end) x [y_start, y_end) into 'out'.
+                    // ! 'start' is what the terminal has before 'out'; Unknown for every band but the first, since they are encoded at the same time.
+                    template <CES_ColorMode M>
+                    void encodeTile(int x_start, int y_start, int x_end, int y_end, int cols, CES_ByteBuffer& out, CES_OutputPlanner& plan, const CES_TermState& start) {
+                        plan.begin(frame, change, &damage, glyphs, width, cols, x_start, x_end, M, dither, start);
+
+                        // Only the dirty rows and inside of them only the dirty cells are visited.
+                        damage.forEachRow(y_start, y_end, [&](int y) {
+                            damage.forEachInRow(y, x_start, x_end, [&](int x) {
+                                encodeCell<M>(x, y, change, cols, out, plan);
+                            });
+                        });
+                    }
+
+                    // The same for every cell of 'frame' which isn't empty; For an empty terminal in an unknown state, so it only depends on 'frame'.
+                    template <CES_ColorMode M>
+                    void encodeFrameTile(int x_start, int y_start, int x_end, int y_end, int cols, CES_ByteBuffer& out, CES_OutputPlanner& plan) {
+                        plan.begin(frame, change, nullptr, glyphs, width, cols, x_start, x_end, M, dither, CES_TermState());
+                        for (int y = y_start; y < y_end; y++) {
+                            for (int x = x_start; x < x_end; x++) {
+                                size_t i = size_t(y) * width + x;
+                                if (frame.attr[i] == 0 && frame.bg[i] == 0 && (frame.glyph[i] == U'\0' || frame.glyph[i] == U' ')) continue;
+                                encodeCell<M>(x, y, frame, cols, out, plan);
+                            }
+                        }
+                    }
+
+                    template <CES_ColorMode M>
+                    inline void encodeCell(int x, int y, const CES_Planes& p, int cols, CES_ByteBuffer& out, CES_OutputPlanner& plan) {
+                        size_t i = size_t(y) * width + x;
+                        // Printed together with the left half.
+                        if (p.attr[i] & CES_ATTR_CONT) return;
+                        plan.moveTo(out, x, y);
+                        if (p.attr[i] & CES_ATTR_PIXELS) {
+                            CES_AnsiEncoder::glyph(out, plan.pixels<M>(out, p.rgba[i], p.bg[i], x, y));
+                            plan.advance();
+                            return;
+                        }
+                        plan.color<M>(out, p.rgba[i], p.bg[i], x, y);
+                        const CES_Glyph& g = plan.glyph(p.glyph[i]);
+                        // The right half would be cut off by the terminal (or wrap into the next row).
+                        if (x + g.width > cols) {
+                            CES_AnsiEncoder::glyph(out, CES_GlyphCache::ascii(U' '));
+                            plan.advance();
+                            return;
+                        }
+                        CES_AnsiEncoder::glyph(out, g);
+                        plan.advance(g.width);
+                    }
+
+                    // !
+                    // ! Full repaint: The terminal is empty, every tile of 'frame' is drawn into 'out'. Tiles whose hash didn't change
+                    // ! since they were encoded are copied from the cache; The rest is encoded like the bands, on the render pool.
+                    // ! Copied, since the writer still sends the frames before while the cache may be encoded again.
+                    // !
+                    void repaintTiles(CES_ByteBuffer& out, int cols, CES_TermState& term_state) {
+                        tile_misses.clear();
+                        for (int t = 0; t < int(tile_cache.size()); t++) {
+                            const CES_TileCache& tc = tile_cache[t];
+                            int x_end = min((t % tiles_x + 1) * CES_TILE_WIDTH, width);
+                            // Only tiles at the right edge depend on the width of the terminal.
+                            bool same_cols = tc.cols == cols || (x_end < cols && x_end < tc.cols);
+                            if (!tc.cols || !same_cols || tc.mode != color_mode || tc.dither != dither || tc.encoded_hash != tc.hash) tile_misses.push_back(t);
+                        }
+
+                        auto encode = [this, cols](int t, CES_OutputPlanner& plan) {
+                            CES_TileCache& tc = tile_cache[t];
+                            int x0 = (t % tiles_x) * CES_TILE_WIDTH, y0 = (t / tiles_x) * CES_TILE_HEIGHT;
+                            int x1 = min(x0 + CES_TILE_WIDTH, width), y1 = min(y0 + CES_TILE_HEIGHT, height);
+                            tc.bytes.clear();
+                            switch (color_mode) {
+                                case CES_TRUECOLOR: encodeFrameTile<CES_TRUECOLOR>(x0, y0, x1, y1, cols, tc.bytes, plan); break;
+                                case CES_256COLOR:  encodeFrameTile<CES_256COLOR>(x0, y0, x1, y1, cols, tc.bytes, plan); break;
+                                case CES_16COLOR:   encodeFrameTile<CES_16COLOR>(x0, y0, x1, y1, cols, tc.bytes, plan); break;
+                            }
+                            tc.after = plan.state();
+                            tc.encoded_hash = tc.hash;
+                            tc.cols = cols;
+                            tc.mode = color_mode;
+                            tc.dither = dither;
+                        };
+
+                        int k = int(min<size_t>(tile_misses.size() * CES_TILE_WIDTH * CES_TILE_HEIGHT / CES_BAND_MIN_CELLS, render_pool->size()));
+                        k = max(k, 1);
+                        if (int(tile_plan.size()) < k) tile_plan.resize(k);
+                        auto job = [this, &encode, k](int j) {
+                            for (size_t m = j; m < tile_misses.size(); m += k) encode(tile_misses[m], tile_plan[j]);
+                        };
+                        try {
+                            runBands(k, job);
+                        } catch (...) {
+                            // Half encoded tiles must not be taken from the cache; Every tile of this repaint is encoded again.
+                            for (int t : tile_misses) {
+                                tile_cache[t].cols = 0;
+                                tile_cache[t].bytes.clear();
+                            }
+                            throw;
+                        }
+
+                        for (const CES_TileCache& tc : tile_cache) {
+                            if (tc.bytes.empty()) continue;
+                            out.put(tc.bytes);
+                            term_state = tc.after;
+                        }
+                    }
+
+                    // What a cell of 'frame' adds to the hash of its tile; The position is part of it, so moved cells count as changed.
+                    inline uint64_t cellHash(int x, int y, size_t i) const noexcept {
+                        uint64_t k = (uint64_t(frame.glyph[i]) << 32 | frame.rgba[i]) * 0x9E3779B97F4A7C15ull;
+                        k ^= (uint64_t(frame.bg[i]) << 8 | frame.attr[i]) * 0xC2B2AE3D27D4EB4Full;
+                        k ^= (uint64_t(y) << 32 | uint32_t(x)) * 0x165667B19E3779F9ull;
+                        // splitmix64
+                        k ^= k >> 30; k *= 0xBF58476D1CE4E5B9ull;
+                        k ^= k >> 27; k *= 0x94D049BB133111EBull;
+                        return k ^ (k >> 31);
+                    }
+
+                    inline uint64_t& tileHash(int x, int y) noexcept {
+                        return tile_cache[size_t(y / CES_TILE_HEIGHT) * tiles_x + x / CES_TILE_WIDTH].hash;
+                    }
+
+                    // The hashes of the tiles in the rows [top, bottom] from scratch.
+                    void rehashTiles(int top, int bottom) {
+                        int ty0 = top / CES_TILE_HEIGHT, ty1 = bottom / CES_TILE_HEIGHT;
+                        for (int ty = ty0; ty <= ty1; ty++) {
+                            for (int tx = 0; tx < tiles_x; tx++) tile_cache[size_t(ty) * tiles_x + tx].hash = 0;
+                            for (int y = ty * CES_TILE_HEIGHT; y < min((ty + 1) * CES_TILE_HEIGHT, height); y++) {
+                                for (int x = 0; x < width; x++) tileHash(x, y) ^= cellHash(x, y, size_t(y) * width + x);
+                            }
+                        }
+                    }
+
+                    // A new grid of tiles for the size of the screen; Tiles which are still there keep their cached bytes.
+                    void resetTiles() {
+                        int tx = (width + CES_TILE_WIDTH - 1) / CES_TILE_WIDTH, ty = (height + CES_TILE_HEIGHT - 1) / CES_TILE_HEIGHT;
+                        if (tx != tiles_x || ty != tiles_y) {
+                            vector<CES_TileCache> t(size_t(tx) * ty);
+                            for (int y = 0; y < min(ty, tiles_y); y++) {
+                                for (int x = 0; x < min(tx, tiles_x); x++) t[size_t(y) * tx + x] = move(tile_cache[size_t(y) * tiles_x + x]);
+                            }
+                            tile_cache = move(t);
+                            tiles_x = tx;
+                            tiles_y = ty;
+                        }
+                        if (height > 0) rehashTiles(0, height - 1);
+                    }
+
+                    // !
+                    // ! Writing never waits for the renderer: Every producer thread has its own staging buffer.
+                    // ! 'OutputCurWindow()' swaps them out at the start of a frame and merges them into 'change'.
+                    // !
+                    inline void writeCell(CES::CES_XY& xy) {
+                        CES_Staging& st = staging();
+                        StagingLock lock(*this, st);
+                        st.cells.push_back(xy);
+                    }
+
+                    // With alpha < 255 the cell is a translucent layer over what is below it (fog, a selection, ...); See 'mergeTint()'.
+                    void writeCell(int x, int y, int z, CES::CES_COLOR color, char32_t c) {
+                        CES_Staging& st = staging();
+                        StagingLock lock(*this, st);
+                        st.cells.emplace_back(x, y, z, color, c);
+                    }
+
+                    inline void writeCell(vector<CES::CES_XY>* xy) {
+                        writeCells(span<const CES::CES_XY>(*xy));
+                    }
+
+                    // Writes a whole batch of cells (a shape, a sprite, ...) with one lock for all of them.
+                    void writeCells(span<const CES::CES_XY> xy) {
+                        CES_Staging& st = staging();
+                        StagingLock lock(*this, st);
+                        st.cells.insert(st.cells.end(), xy.begin(), xy.end());
+                    }
+
+                    // Writes the glyphs from (x, y) to the right, all with the same z; A wide glyph takes two cells.
+                    // ! Merged with one vectorized depth test, as long as there is nothing wide in the way.
+                    // ! Glyphs past the end of 'colors' take its last color; Without any colors the row is opaque black, the default 'CES_COLOR'.
+                    void writeRow(int x, int y, int z, span<const char32_t> glyphs, span<const CES::CES_COLOR> colors) {
+                        CES_Staging& st = staging();
+                        StagingLock lock(*this, st);
+                        st.rows.push_back({ x, y, z, uint32_t(glyphs.size()), st.row_glyph.size(), st.cells.size() });
+                        st.row_glyph.insert(st.row_glyph.end(), glyphs.begin(), glyphs.end());
+                        for (size_t i = 0; i < glyphs.size(); i++) {
+                            st.row_rgba.push_back(colors.empty() ? CES::CES_COLOR().to_uint() : colors[min(i, colors.size() - 1)].to_uint());
+                        }
+                        // The default background.
+                        st.row_bg.resize(st.row_glyph.size(), 0);
+                    }
+
+                    // The same, with one color for the whole row.
+                    void writeRow(int x, int y, int z, span<const char32_t> glyphs, CES::CES_COLOR color) {
+                        writeRow(x, y, z, glyphs, span<const CES::CES_COLOR>(&color, 1));
+                    }
+
+                    // !
+                    // ! Half block mode: Every cell from (x, y) on shows two pixels of 'canvas' on top of each other.
+                    // ! The canvas is written on its own z again and again; Only the pixel pairs which aren't on the screen yet are sent.
+                    // ! Meant for 'supportsRGB': With less colors the pixels get the nearest ones, like every other cell.
+                    // !
+                    void drawPixels(const CES_PixelCanvas& canvas, int x, int y, int z) {
+                        CES_Staging& st = staging();
+                        StagingLock lock(*this, st);
+                        size_t w = canvas.width;
+                        for (int r = 0; r < canvas.height / 2; r++) {
+                            const uint32_t* top = canvas.row(2 * r);
+                            st.rows.push_back({ x, y + r, z, uint32_t(w), st.row_glyph.size(), st.cells.size(), CES_ATTR_PIXELS, true });
+                            st.row_glyph.resize(st.row_glyph.size() + w, U'▀');
+                            st.row_rgba.insert(st.row_rgba.end(), top, top + w);
+                            st.row_bg.insert(st.row_bg.end(), top + w, top + 2 * w);
+                        }
+                    }
+
+                    // !
+                    // ! Braille mode: Every cell from (x, y) on shows 2 x 4 dots of 'canvas', all in 'color'; Cells without dots are spaces.
+                    // ! Only the cells whose dots changed since the last time are written (see 'CES_BrailleCanvas::redraw()').
+                    // ! Like 'drawPixels()', the canvas replaces itself on its own z.
+                    // !
+                    void drawBraille(CES_BrailleCanvas& canvas, int x, int y, int z, CES::CES_COLOR color) {
+                        CES_Staging& st = staging();
+                        StagingLock lock(*this, st);
+                        uint32_t rgba = color.to_uint();
+                        for (int cy = 0; cy < canvas.rows; cy++) {
+                            uint64_t* d = &canvas.dirty[size_t(cy) * canvas.cell_words];
+                            for (size_t w = 0; w < canvas.cell_words; w++) {
+                                // Every run of dirty cells is one row.
+                                while (d[w]) {
+                                    int a = countr_zero(d[w]);
+                                    int n = countr_one(d[w] >> a);
+                                    d[w] &= n == 64 ? 0 : ~(((uint64_t(1) << n) - 1) << a);
+                                    int cx = int(w * 64) + a;
+                                    st.rows.push_back({ x + cx, y + cy, z, uint32_t(n), st.row_glyph.size(), st.cells.size(), 0, true });
+                                    for (int k = 0; k < n; k++) {
+                                        uint8_t m = canvas.cellMask(cx + k, cy);
+                                        st.row_glyph.push_back(m ? char32_t(0x2800 + m) : U' ');
+                                    }
+                                    st.row_rgba.insert(st.row_rgba.end(), n, rgba);
+                                    st.row_bg.insert(st.row_bg.end(), n, 0);
+                                }
+                            }
+                        }
+                    }
+
+                    // !
+                    // ! Shows [cx, cx + w) x [cy, cy + h) of 'canvas' from (x, y) on. Only the cells which changed since they were drawn
+                    // ! are written, unless this isn't the part and the place of the last time; Then all of them are.
+                    // ! Like 'drawPixels()', the canvas replaces itself on its own z; Where it was before has to be removed like any other cell.
+                    // !
+                    void drawCells(CES_CellCanvas& canvas, int cx, int cy, int x, int y, int w, int h, int z) {
+                        CES_Staging& st = staging();
+                        StagingLock lock(*this, st);
+                        CES_CellCanvas::View view = { cx, cy, x, y, w, h, z };
+                        if (canvas.view != view) {
+                            canvas.view = view;
+                            canvas.redraw();
+                        }
+                        int c0 = max(cx, 0), c1 = min(cx + w, canvas.width);
+                        for (int r = max(cy, 0); r < min(cy + h, canvas.height); r++) {
+                            const CES_Cell* cells = canvas.row(r);
+                            const uint64_t* d = &canvas.dirty[size_t(r) * canvas.words];
+                            int c = c0;
+                            while (c < c1) {
+                                uint64_t bits = d[c >> 6] >> (c & 63);
+                                if (!bits) {
+                                    c = (c | 63) + 1;
+                                    continue;
+                                }
+                                c += countr_zero(bits);
+                                if (c >= c1) break;
+                                // One row per run of dirty cells with the same attributes.
+                                int start = c;
+                                uint8_t attr = cells[c].attr();
+                                while (c < c1 && canvas.isDirty(c, r) && cells[c].attr() == attr) c++;
+                                st.rows.push_back({ x + start - cx, y + r - cy, z, uint32_t(c - start), st.row_glyph.size(), st.cells.size(), attr, true });
+                                for (int k = start; k < c; k++) {
+                                    // Also for cells written without 'set()'.
+                                    st.row_glyph.push_back(CES_GlyphCache::oneCell(cells[k].glyph()));
+                                    st.row_rgba.push_back(canvas.colors.fg(cells[k].colors()));
+                                    st.row_bg.push_back(canvas.colors.bg(cells[k].colors()));
+                                }
+                            }
+                            if (c0 < c1) canvas.clean(r, c0, c1);
+                        }
+                    }
+
+                    // !
+                    // ! Draws 'sprite' with its top left cell at (x, y) on z, flipped by 'flags' ('CES_BlitFlags'); Transparent cells keep what is below.
+                    // ! Every row of the sprite is copied as a whole from the atlas into one row write, and merged like 'writeRow()' with its mask.
+                    // ! What is off the screen is cut off: Left and top here, right and bottom while merging (the size can change until then).
+                    // !
+                    void blit(const CES_Sprite& sprite, int x, int y, int z, uint8_t flags = 0) {
+                        if (!sprite.atlas) return;
+                        const CES_SpriteAtlas& a = *sprite.atlas;
+                        int skip = max(0, -x);
+                        int n = sprite.width - skip;
+                        if (n <= 0) return;
+                        bool flip = flags & CES_BLIT_FLIP_H;
+                        CES_Staging& st = staging();
+                        StagingLock lock(*this, st);
+                        for (int r = max(0, -y); r < sprite.height; r++) {
+                            // Flipped, the cells cut off on the left are the last ones of the sprite row.
+                            size_t from = sprite.at(flip ? 0 : skip, flags & CES_BLIT_FLIP_V ? sprite.height - 1 - r : r);
+                            size_t o = st.row_glyph.size(), mo = st.row_mask.size();
+                            st.rows.push_back({ x + skip, y + r, z, uint32_t(n), o, st.cells.size(), 0, false, mo });
+                            auto copyRow = [&](auto& to, const auto& row) {
+                                if (!flip) {
+                                    to.insert(to.end(), row.begin() + from, row.begin() + from + n);
+                                    return;
+                                }
+                                size_t at = to.size();
+                                to.resize(at + n);
+                                reverse_copy(row.begin() + from, row.begin() + from + n, to.begin() + at);
+                            };
+                            copyRow(st.row_glyph, a.glyph);
+                            copyRow(st.row_rgba, a.rgba);
+                            copyRow(st.row_bg, a.bg);
+                            copyRow(st.row_mask, a.mask);
+                            if (flags & CES_BLIT_KEY) {
+                                for (int k = 0; k < n; k++) st.row_mask[mo + k] &= st.row_glyph[o + k] != a.key;
+                            }
+                            if (!flip) continue;
+                            // A wide glyph lands right of its (transparent) second cell; Back to the left of it.
+                            for (int k = 1; k < n; k++) {
+                                if (!st.row_mask[mo + k] || st.row_mask[mo + k - 1] || st.row_glyph[o + k] < 0x1100 || CES_GlyphCache::displayWidth(st.row_glyph[o + k]) != 2) continue;
+                                swap(st.row_glyph[o + k], st.row_glyph[o + k - 1]);
+                                swap(st.row_rgba[o + k], st.row_rgba[o + k - 1]);
+                                swap(st.row_bg[o + k], st.row_bg[o + k - 1]);
+                                swap(st.row_mask[mo + k], st.row_mask[mo + k - 1]);
+                                k++;
+                            }
+                        }
+                    }
+
+                    // !
+                    // ! Named layers (background, world, entities, HUD, ...), each with its own sparse cells on its own z. Erasing a cell of
+                    // ! a layer shows what the layers below have there, without drawing them again; So does 'removeCell()'.
+                    // ! Cells of 'writeCell()' are still on top where their z is higher. Like canvas cells, layer cells are one cell wide: A wide glyph becomes a '?'.
+                    // ! The same name gives the same layer.
+                    // !
+                    int addLayer(const string& name, int z) {
+                        lock_guard<mutex> lock(layers_mtx);
+                        for (size_t i = 0; i < layers.size(); i++) {
+                            if (layers[i]->name == name) return int(i);
+                        }
+                        layers.push_back(make_unique<CES_Layer>());
+                        layers.back()->name = name;
+                        layers.back()->z = z;
+                        sortLayers();
+                        return int(layers.size() - 1);
+                    }
+
+                    // -1 if there is none.
+                    int findLayer(const string& name) {
+                        lock_guard<mutex> lock(layers_mtx);
+                        for (size_t i = 0; i < layers.size(); i++) {
+                            if (layers[i]->name == name) return int(i);
+                        }
+                        return -1;
+                    }
 
-                        // ! Needs to be cleared.
-                        change.clear();
-                        erase_frame.clear();
-                        frame.insert(thread_0.begin(), thread_0.end());
-                        frame.insert(thread_1.begin(), thread_1.end());
-                        frame.insert(thread_2.begin(), thread_2.end());
-                        frame.insert(thread_3.begin(), thread_3.end());
+                    void layerWrite(int layer, int x, int y, CES::CES_COLOR color, char32_t c, CES::CES_COLOR bg = CES::CES_COLOR(0, 0, 0, 0), uint8_t attr = 0) {
+                        CES_Layer& l = layerAt(layer);
+                        lock_guard<mutex> lock(l.mtx);
+                        uint64_t k = CES_Layer::key(x, y);
+                        // Resolved cell by cell, so nothing may reach into the cell to the right.
+                        CES_Cell cell(CES_GlyphCache::oneCell(c), l.colors.intern(color, bg), attr & ~CES_ATTR_CONT);
+                        auto [it, added] = l.cells.try_emplace(k, cell);
+                        if (!added) {
+                            if (it->second == cell) return;
+                            it->second = cell;
+                        }
+                        l.dirty.push_back(k);
+                    }
 
-                        lock_all.unlock();  // <-- Lock from the start of this function
-                    }*/
+                    void layerErase(int layer, int x, int y) {
+                        CES_Layer& l = layerAt(layer);
+                        lock_guard<mutex> lock(l.mtx);
+                        uint64_t k = CES_Layer::key(x, y);
+                        if (l.cells.erase(k)) l.dirty.push_back(k);
+                    }
 
-                    void OutputCurWindow() {
-                        // Terminal Size
-                        pair<int, int> size = WidthHeight();
-                        // Blocking every thread to write anything else
-                        unique_lock<mutex> lock_all(mtx_write);
+                    void layerClear(int layer) {
+                        CES_Layer& l = layerAt(layer);
+                        lock_guard<mutex> lock(l.mtx);
+                        l.markAll();
+                        l.cells.clear();
+                    }
 
-                        // Important pointer pointing to the storage of the 'change'.
-                        auto main = &change;
-                        
-                        // A compiler definition for opening the 'CES_THREAD_POOL'-Unit.
-                        // ! Note: Basically you don't have to define 'CES_THREAD_POOL' in your main code when you are defining: 'CES_CELL_SYSTEM'.
+                    void setLayerVisible(int layer, bool on) {
+                        CES_Layer& l = layerAt(layer);
+                        lock_guard<mutex> lock(l.mtx);
+                        if (l.visible == on) return;
+                        l.visible = on;
+                        l.markAll();
+                    }
 
-                        #define CES_THREAD_POOL
+                    void setLayerZ(int layer, int z) {
+                        lock_guard<mutex> lock(layers_mtx);
+                        CES_Layer& l = *layers.at(layer);
+                        lock_guard<mutex> l_lock(l.mtx);
+                        if (l.z == z) return;
+                        l.z = z;
+                        l.markAll();
+                        sortLayers();
+                    }
 
-                        // A Threadpool with 4 threads is needed to split the screen of the terminal for optimize rendering.
-                        ThreadPool pool(4);
+                    // !
+                    // ! Moves the rows [top, bottom] (inclusive) by 'dy' rows up, or down with a negative 'dy'; The terminal does it
+                    // ! itself (DECSTBM + SU/SD), so only the rows which come in have to be written. They start empty.
+                    // ! Always the whole width: Left and right margins (DECSLRM) aren't supported by enough terminals.
+                    // !
+                    void scrollRegion(int top, int bottom, int dy) {
+                        CES_Staging& st = staging();
+                        StagingLock lock(*this, st);
+                        st.scrolls.push_back({ top, bottom, dy, st.cells.size(), st.rows.size() });
+                    }
 
-                        // Defining 4 objects for storing every calculated cell on each area of threads. (new frame)
-                        string thread_0;
-                        string thread_1;
-                        string thread_2;
-                        string thread_3;
+                    // A removed cell has the z index INT_MIN; It always wins against what is on the screen.
+                    void removeCell(int x, int y) {
+                        CES_Staging& st = staging();
+                        StagingLock lock(*this, st);
+                        st.cells.emplace_back(x, y, INT_MIN, CES::CES_COLOR(0,0,0), U' ');
+                    }
 
-                        // !
-                        // ! Tiles are numbered clockwise. (Thread 0: left-top, thread 1: right-top, thread 2: right-bottom, thread 3: left-bottom)
-                        // !
+                    void removeCell(CES::CES_XY& xy) {
+                        xy.ARGB = CES_COLOR(0,0,0);
+                        xy.c = ' ';
+                        xy.z = INT_MIN;
+                        CES_Staging& st = staging();
+                        StagingLock lock(*this, st);
+                        st.cells.push_back(xy);
+                    }
 
-                        // This variable is waiting for every thread to finish
-                        // Then the main thread will proceed.
-                        atomic<int> remaining = 4;
+                    void removeCell(vector<CES::CES_XY>* xy) {
+                        removeCells(span<const CES::CES_XY>(*xy));
+                    }
 
-                        // Thread 0
-                        pool.enqueue([&main, &size, &thread_0, &remaining]() {
-                            // Current x position of a cell; Firstly declared with the maximum of the terminal x to calculate the 'x_end' for this thread area.
-                            int x = size.first;
-                            // Current y position of a cell; Firstly declared with the maximum of the terminal y to calculate the 'y_end' for this thread area.
-                            int y = size.second;
+                    // Removes a whole batch of cells with one lock; Only x and y of the cells are used.
+                    void removeCells(span<const CES::CES_XY> xy) {
+                        CES_Staging& st = staging();
+                        StagingLock lock(*this, st);
+                        for (const auto& c : xy) st.cells.emplace_back(c.x, c.y, INT_MIN, CES::CES_COLOR(0,0,0), U' ');
+                    }
 
-                            // 'x_start' used to define the START for x for the area of this thread.
-                            int x_start = 0; 
-                            // Same applies for the y.
-                            int y_start = 0;
-                            // ! --> START for thread 0 is in the UPPER LEFT CORNER.
+                    // !
+                    // ! Fixes where the writes of the calling thread are merged: Lower first, so on the same (x, y) and z a higher one wins.
+                    // ! Threads without one come after them, in the order they wrote their first cell. That order depends on the
+                    // ! scheduling, so producers which draw over each other on the same z should call this before they write.
+                    // !
+                    void setProducerOrder(int order) {
+                        CES_Staging& st = staging();
+                        lock_guard<mutex> lock(staging_mtx);
+                        st.order = order;
+                        stable_sort(stagings.begin(), stagings.end(), [](const auto& a, const auto& b) { return a->order < b->order; });
+                    }
 
-                            // 'x_end' used to define the END for x for the area of this thread.
-                            int x_end = x / 2;
-                            // Same applies for the y.
-                            int y_end = y / 2;
-                            // ! --> END for thread 0 is in the middle of the ENTIRE screen.
+                    // !
+                    // ! The staging buffer of the calling thread; Registered on its first write.
+                    // ! A buffer holds at most about 'staging_limit' writes: A producer which runs that far ahead of the frames merges
+                    // ! every buffer into 'change' itself ('StagingLock'), waiting for a frame which is encoded right then.
+                    // !
+                    CES_Staging& staging() {
+                        // Remembered per thread, so the registry is only locked once.
+                        thread_local uint64_t cached_screen = 0;
+                        thread_local CES_Staging* cached = nullptr;
+                        thread_local CES_StagingOwner owned;
+                        if (cached_screen == screen_id) return *cached;
+
+                        lock_guard<mutex> lock(staging_mtx);
+                        thread::id me = this_thread::get_id();
+                        CES_Staging* found = nullptr;
+                        for (auto& st : stagings) {
+                            // An id can come back after a thread ended, its buffer is not ours.
+                            if (st->owner == me && !st->ended.load(memory_order_relaxed)) { found = st.get(); break; }
+                        }
+                        if (!found) {
+                            // Without an order yet, so behind every other one.
+                            auto st = make_shared<CES_Staging>();
+                            st->owner = me;
+                            // The buffers of screens which are gone.
+                            erase_if(owned.buffers, [](const auto& b) { return b.use_count() == 1; });
+                            owned.buffers.push_back(st);
+                            stagings.push_back(move(st));
+                            found = stagings.back().get();
+                        }
 
-                            /*Making ANSI more easier for the terminal*/
-                            CES_XY old;
-                            bool set = false;
+                        cached_screen = screen_id;
+                        cached = found;
+                        return *found;
+                    }
 
-                            for (auto c : *main) {
-                                if (c.x < x_start || c.x >= x_end || c.y < y_start || c.y >= y_end) continue;
-                                if (c.c == U'\0') continue;
-                                if (!set) {
-                                    goto normal_set;
-                                }
-                                if (old.ARGB == c.ARGB) {
-                                    thread_0 += c.convertCHAR32toCHAR(c.c);
-                                } else {
-                                    if (old.c != U'\0') thread_0 += "\033[0m";
-                                    goto normal_set;
-                                }
+                    // Locks a staging buffer for one write; Over 'staging_limit' every buffer is merged right after it is unlocked.
+                    class StagingLock {
+                        CES_Screen& screen;
+                        CES_Staging& st;
 
-                                normal_set:
-                                    thread_0 += "\033[" + to_string(c.y+1) + ";" + to_string(c.x+1) + "H";
-                                    thread_0 += "\033[38;2;" +
-                                        to_string((int)c.ARGB.r) + ";" +
-                                        to_string((int)c.ARGB.g) + ";" +
-                                        to_string((int)c.ARGB.b) + "m";
-                                    thread_0 += c.convertCHAR32toCHAR(c.c);
-                                    old = c;
-                                    set = true;
+                        public:
+                            StagingLock(CES_Screen& screen, CES_Staging& st) : screen(screen), st(st) { st.mtx.lock(); }
+                            StagingLock(const StagingLock&) = delete;
+                            StagingLock& operator=(const StagingLock&) = delete;
+
+                            ~StagingLock() {
+                                bool full = st.size() > screen.staging_limit;
+                                st.mtx.unlock();
+                                if (full) screen.mergeEarly();
                             }
+                    };
 
-                            remaining.fetch_sub(1, memory_order_release);
-                        });
+                    // A producer ran too far ahead: What is staged goes into 'change' now. Waits for a frame which is encoded right then.
+                    void mergeEarly() {
+                        lock_guard<mutex> lock(mtx_write);
+                        mergeStagings();
+                    }
 
-                        // Thread 1
-                        pool.enqueue([&main, &size, &thread_1, &remaining]() {
-                            // Current x position of a cell; Firstly declared with the maximum of the terminal x to calculate the 'x_end' for this thread area.
-                            int x = size.first;
-                            // Current y position of a cell; Firstly declared with the maximum of the terminal y to calculate the 'y_end' for this thread area.
-                            int y = size.second;
+                    // Moves everything the producers wrote since the last frame into 'change'.
+                    // ! The same (x, y): The higher z wins. On the same z the later write wins; The threads are merged by 'setProducerOrder()',
+                    // ! then in the order they wrote their first cell.
+                    void mergeStagings() {
+                        lock_guard<mutex> lock(staging_mtx);
+                        for (auto& st : stagings) {
+                            // Read before the swap, so the last writes of an ended thread are in it.
+                            bool ended = st->ended.load(memory_order_acquire);
+                            {
+                                // The producer only waits for this swap, never for the rendering.
+                                lock_guard<mutex> l(st->mtx);
+                                st->swapContent(merging);
+                            }
 
-                            // 'x_start' used to define the START for x for the area of this thread.
-                            int x_start = x/2; 
-                            // Same applies for the y.
-                            int y_start = 0;
-                            // ! --> START for thread 0 is in the UPPER LEFT CORNER.
+                            // Scrolls, rows and single cells in the order they were written.
+                            size_t r = 0, sc = 0;
+                            for (size_t i = 0; i <= merging.cells.size(); i++) {
+                                while (true) {
+                                    if (sc < merging.scrolls.size() && merging.scrolls[sc].after == i && merging.scrolls[sc].rows_before == r) mergeScroll(merging.scrolls[sc++]);
+                                    else if (r < merging.rows.size() && merging.rows[r].after == i) mergeRow(merging.rows[r++]);
+                                    else break;
+                                }
+                                if (i < merging.cells.size()) mergeCell(merging.cells[i]);
+                            }
+                            // Keeps its memory for the next swap.
+                            merging.clear();
+                            if (ended) st.reset();
+                        }
+                        erase_if(stagings, [](const auto& st) { return !st; });
+                        composeLayers();
+                        if (!tints.empty()) settleTints();
+                    }
 
-                            // 'x_end' used to define the END for x for the area of this thread.
-                            int x_end = x;
-                            // Same applies for the y.
-                            int y_end = y / 2;
-                            // ! --> END for thread 0 is in the middle of the ENTIRE screen.
+                    inline CES_Layer& layerAt(int layer) {
+                        lock_guard<mutex> lock(layers_mtx);
+                        return *layers.at(layer);
+                    }
 
-                            CES_XY old;
+                    // Highest z first; On the same z the older layer.
+                    void sortLayers() {
+                        layer_order.clear();
+                        for (auto& l : layers) layer_order.push_back(l.get());
+                        stable_sort(layer_order.begin(), layer_order.end(), [](const CES_Layer* a, const CES_Layer* b) { return a->z > b->z; });
+                    }
 
-                            for (auto c : *main) {
-                                if (c.x < x_start || c.x >= x_end || c.y < y_start || c.y >= y_end) continue;
-                                if (c.c == NULL) continue;
-                                if (old.ARGB == c.ARGB) {
-                                    thread_1 += c.convertCHAR32toCHAR(c.c);
-                                } else {
-                                    if (old.c != NULL) thread_1 += "\033[0m";
-                                    thread_1 += "\033[" + to_string(c.y+1) + ";" + to_string(x+1) + "H";
-                                    thread_1 += "\033[38;2;" +
-                                        to_string((int)c.ARGB.r) + ";" +
-                                        to_string((int)c.ARGB.g) + ";" +
-                                        to_string((int)c.ARGB.b) + "m";
-                                    thread_1 += c.convertCHAR32toCHAR(c.c);
-                                    old = c;
+                    // !
+                    // ! Resolves every position which changed in a layer, was removed or moved: The highest visible layer with a cell there wins,
+                    // ! without any it is an empty cell. Before 'settleTints()', so translucent cells stay over the layers.
+                    // !
+                    void composeLayers() {
+                        lock_guard<mutex> lock(layers_mtx);
+                        if (layers.empty()) {
+                            layer_todo.clear();
+                            relayer_rows.clear();
+                            return;
+                        }
+                        vector<unique_lock<mutex>> locks;
+                        locks.reserve(layers.size());
+                        for (auto& l : layers) locks.emplace_back(l->mtx);
+
+                        for (auto& l : layers) {
+                            layer_todo.insert(layer_todo.end(), l->dirty.begin(), l->dirty.end());
+                            l->dirty.clear();
+                        }
+                        for (auto [top, bottom] : relayer_rows) {
+                            top = max(top, 0);
+                            bottom = min(bottom, height - 1);
+                            for (int y = top; y <= bottom; y++) {
+                                for (int x = 0; x < width; x++) {
+                                    if (shownAttr(x, y) & CES_ATTR_LAYER) layer_todo.push_back(CES_Layer::key(x, y));
                                 }
                             }
+                            for (auto& l : layers) {
+                                for (const auto& [k, c] : l->cells) {
+                                    if (CES_Layer::keyY(k) >= top && CES_Layer::keyY(k) <= bottom) layer_todo.push_back(k);
+                                }
+                            }
+                        }
+                        relayer_rows.clear();
 
-                            remaining.fetch_sub(1, memory_order_release);
-                        });
-
-                        // Thread 2
-                        pool.enqueue([&main, &size, &thread_0, &frame_0, &remaining, this]() {
-                            // Current x position of a cell; Firstly declared with the maximum of the terminal x to calculate the 'x_end' for this thread area.
-                            int x = size.first;
-                            // Current y position of a cell; Firstly declared with the maximum of the terminal y to calculate the 'y_end' for this thread area.
-                            int y = size.second;
+                        for (uint64_t k : layer_todo) resolveLayers(CES_Layer::keyX(k), CES_Layer::keyY(k));
+                        layer_todo.clear();
+                    }
 
-                            // 'x_start' used to define the START for x for the area of this thread.
-                            int x_start = x/2; 
-                            // Same applies for the y.
-                            int y_start = y/2;
-                            // ! --> START for thread 0 is in the UPPER LEFT CORNER.
+                    void resolveLayers(int x, int y) {
+                        if (x < 0 || y < 0 || x >= width || y >= height) return;
+                        size_t i = size_t(y) * width + x;
+                        bool dirty = damage.isDirty(x, y);
+                        const CES_Planes& p = dirty ? change : frame;
+                        for (const CES_Layer* l : layer_order) {
+                            if (!l->visible) continue;
+                            auto it = l->cells.find(CES_Layer::key(x, y));
+                            if (it == l->cells.end()) continue;
+                            // A cell of 'writeCell()' over the layers.
+                            if (!(p.attr[i] & CES_ATTR_LAYER) && p.depth[i] > l->z) return;
+                            const CES_Cell& c = it->second;
+                            uint32_t fg = l->colors.fg(c.colors()), bg = l->colors.bg(c.colors());
+                            uint8_t attr = c.attr() | CES_ATTR_LAYER;
+                            if (!dirty && frame.depth[i] == l->z && showsBelow(i, c.glyph(), fg, bg, attr)) return;
+                            place(x, y, c.glyph(), fg, bg, l->z, attr);
+                            return;
+                        }
+                        // No layer has a cell there (anymore): Like 'removeCell()'.
+                        if (p.attr[i] & CES_ATTR_LAYER) place(x, y, U' ', CES_COLOR(0, 0, 0).to_uint(), 0, INT_MIN, 0);
+                    }
 
-                            // 'x_end' used to define the END for x for the area of this thread.
-                            int x_end = x;
-                            // Same applies for the y.
-                            int y_end = y;
-                            // ! --> END for thread 0 is in the middle of the ENTIRE screen.
+                    // ! A cell is taken if its z is higher than on the screen and not lower than what is pending.
+                    // ! Cells which aren't pending have the z INT_MIN in 'change', so both tests work without looking at 'damage'.
+                    inline bool accepts(size_t i, int z) const noexcept { return frame.depth[i] < z && change.depth[i] <= z; }
 
-                            for (auto c : *main) {
-                                if (c.x < x_start || c.x >= x_end || c.y < y_start || c.y >= y_end) continue;
-                                if (c.c == NULL) continue;
-                                if (old.ARGB == c.ARGB) {
-                                    thread_0 += c.convertCHAR32toCHAR(c.c);
-                                } else {
-                                    if (old.c != NULL) thread_0 += "\033[0m";
-                                    thread_0 += "\033[" + to_string(c.y+1) + ";" + to_string(x+1) + "H";
-                                    thread_0 += "\033[38;2;" +
-                                        to_string((int)c.ARGB.r) + ";" +
-                                        to_string((int)c.ARGB.g) + ";" +
-                                        to_string((int)c.ARGB.b) + "m";
-                                    thread_0 += c.convertCHAR32toCHAR(c.c);
-                                    old = c;
-                                }
+                    // 'bg' is the background of an opaque cell; Only rows have one ('row_bg').
+                    inline void mergeCell(const CES_XY& c, uint32_t bg = 0) {
+                        if (c.x < 0 || c.y < 0 || c.x >= width || c.y >= height) return;
+                        if (c.ARGB.a != 255 && c.z != INT_MIN) {
+                            mergeTint(c);
+                            return;
+                        }
+                        size_t i = size_t(c.y) * width + c.x;
+                        // Removing always wins; What the layers have there comes back.
+                        if (c.z == INT_MIN) layer_todo.push_back(CES_Layer::key(c.x, c.y));
+                        else if (!accepts(i, c.z)) return;
+                        uint32_t rgba = c.ARGB.to_uint();
+                        if (glyphs.add(c.c).width == 2) {
+                            // The right half needs the next cell too; Without it (last column, a higher z there) only a space is left.
+                            if (c.x + 1 < width && accepts(i + 1, c.z)) {
+                                place(c.x, c.y, c.c, rgba, bg, c.z, 0);
+                                place(c.x + 1, c.y, U'\0', rgba, bg, c.z, CES_ATTR_CONT);
+                            } else {
+                                place(c.x, c.y, U' ', rgba, bg, c.z, 0);
                             }
+                            return;
+                        }
+                        place(c.x, c.y, c.c, rgba, bg, c.z, 0);
+                    }
 
-                            remaining.fetch_sub(1, memory_order_release);
-                        });
+                    // Writes one cell into 'change'; A wide glyph which loses one of its halves by that, turns into a space (like in the terminal).
+                    // ! Every write into 'change' has to go through here (or mark its cell), otherwise it won't be rendered.
+                    inline void place(int x, int y, char32_t c, uint32_t rgba, uint32_t bg, int32_t z, uint8_t attr) {
+                        size_t i = size_t(y) * width + x;
+                        if (shownAttr(x, y) & CES_ATTR_CONT) breakWide(x - 1, y);
+                        if (x + 1 < width && (shownAttr(x + 1, y) & CES_ATTR_CONT)) breakWide(x + 1, y);
+                        change.glyph[i] = c;
+                        change.rgba[i] = rgba;
+                        change.bg[i] = bg;
+                        change.depth[i] = z;
+                        change.attr[i] = attr;
+                        damage.mark(x, y);
+                    }
 
-                        // Thread 3
-                        pool.enqueue([&main, &size, &thread_0, &frame_0, &remaining, this]() {
-                            // Current x position of a cell; Firstly declared with the maximum of the terminal x to calculate the 'x_end' for this thread area.
-                            int x = size.first;
-                            // Current y position of a cell; Firstly declared with the maximum of the terminal y to calculate the 'y_end' for this thread area.
-                            int y = size.second;
+                    inline uint8_t shownAttr(int x, int y) const noexcept {
+                        size_t i = size_t(y) * width + x;
+                        return damage.isDirty(x, y) ? change.attr[i] : frame.attr[i];
+                    }
 
-                            // 'x_start' used to define the START for x for the area of this thread.
-                            int x_start = 0;
-                            // Same applies for the y.
-                            int y_start = y/2;
-                            // ! --> START for thread 0 is in the UPPER LEFT CORNER.
+                    // Keeps the color and the z index of the cell.
+                    void breakWide(int x, int y) {
+                        size_t i = size_t(y) * width + x;
+                        if (!damage.isDirty(x, y)) change.copy(i, frame, i);
+                        change.glyph[i] = U' ';
+                        change.attr[i] &= CES_ATTR_TINT;
+                        damage.mark(x, y);
+                    }
 
-                            // 'x_end' used to define the END for x for the area of this thread.
-                            int x_end = x/2;
-                            // Same applies for the y.
-                            int y_end = y;
-                            // ! --> END for thread 0 is in the middle of the ENTIRE screen.
+                    // !
+                    // ! A cell with alpha < 255 is a translucent layer: It tints the colors of the cell below (not its glyph) instead of replacing it.
+                    // ! One layer per z; The same z replaces it, alpha 0 removes it. Layers under the cell below are never seen, so they aren't kept.
+                    // ! Removing the cell below keeps the layers over it, like fog over an empty spot.
+                    // !
+                    void mergeTint(const CES_XY& c) {
+                        size_t i = size_t(c.y) * width + c.x;
+                        bool dirty = damage.isDirty(c.x, c.y);
+                        const CES_Planes& p = dirty ? change : frame;
+                        if (c.z <= p.depth[i]) return;
+                        uint32_t rgba = c.ARGB.to_uint();
+
+                        auto it = tints.find(i);
+                        if (it == tints.end() && c.ARGB.a == 0) return;
+                        bool rebase = !(p.attr[i] & CES_ATTR_TINT);
+                        if (it != tints.end() && !rebase) {
+                            // Written again, every frame: Nothing changes, nothing is sent.
+                            auto& l = it->second.layers;
+                            auto at = lower_bound(l.begin(), l.end(), c.z, [](const CES_Tint& t, int32_t z) { return t.z < z; });
+                            if (at != l.end() && at->z == c.z ? at->rgba == rgba : c.ARGB.a == 0) return;
+                        }
 
-                            for (auto c : *main) {
-                                if (c.x < x_start || c.x >= x_end || c.y < y_start || c.y >= y_end) continue;
-                                this->set(c.x, c.y, thread_0, c);
-                            }
+                        if (!dirty) {
+                            change.copy(i, frame, i);
+                            damage.mark(c.x, c.y);
+                        }
+                        if (it == tints.end()) it = tints.emplace(i, CES_TintStack()).first;
+                        if (rebase) setBelow(i, it->second);
+
+                        auto& l = it->second.layers;
+                        auto at = lower_bound(l.begin(), l.end(), c.z, [](const CES_Tint& t, int32_t z) { return t.z < z; });
+                        if (at != l.end() && at->z == c.z) {
+                            if (c.ARGB.a == 0) l.erase(at);
+                            else at->rgba = rgba;
+                        } else if (c.ARGB.a != 0) {
+                            l.insert(at, { c.z, rgba });
+                        }
+                        blendTints(i, it);
+                    }
 
-                            remaining.fetch_sub(1, memory_order_release);
-                        });
+                    // The cell in 'change' is new, so it is the one below the layers now; The layers it covers are gone.
+                    inline void setBelow(size_t i, CES_TintStack& t) {
+                        t.fg = change.rgba[i];
+                        t.bg = change.bg[i];
+                        int32_t z = change.depth[i];
+                        erase_if(t.layers, [z](const CES_Tint& l) { return l.z <= z; });
+                    }
 
-                        while (remaining.load(memory_order_acquire) > 0) {
-                            this_thread::yield();
-                            this_thread::sleep_for(chrono::milliseconds(1));
+                    // Blends the layers over the cell below into 'change'; Without any layer it is just that cell again.
+                    void blendTints(size_t i, unordered_map<size_t, CES_TintStack>::iterator it) {
+                        const CES_TintStack& t = it->second;
+                        if (t.layers.empty()) {
+                            change.rgba[i] = t.fg;
+                            change.bg[i] = t.bg;
+                            change.attr[i] &= ~CES_ATTR_TINT;
+                            tints.erase(it);
+                            return;
                         }
+                        uint32_t fg = t.fg, bg = t.bg;
+                        for (const CES_Tint& l : t.layers) CES_Blend::over2(l.rgba, fg, bg);
+                        change.rgba[i] = fg;
+                        change.bg[i] = bg;
+                        change.attr[i] |= CES_ATTR_TINT;
                     }
 
-                    inline void writeCell(CES::CES_XY& xy) {
-                        unique_lock<mutex> lock_all(mtx_write); // <-- Write permission mutex
-                        if (at(xy.x, xy.y, frame).z >= xy.z) return;
-                        set(xy.x, xy.y, change, xy);
-                        lock_all.unlock();
+                    // After merging: Cells which were written under their layers (they lost CES_ATTR_TINT) are blended again.
+                    void settleTints() {
+                        for (auto it = tints.begin(); it != tints.end();) {
+                            size_t i = it->first;
+                            auto next = std::next(it);
+                            if (damage.isDirty(int(i % width), int(i / width)) && !(change.attr[i] & CES_ATTR_TINT)) {
+                                setBelow(i, it->second);
+                                // Nothing left over it: 'change' has the cell as it was written.
+                                if (it->second.layers.empty()) tints.erase(it);
+                                else blendTints(i, it);
+                            }
+                            it = next;
+                        }
                     }
 
-                    void writeCell(int x, int y, int z, CES::CES_COLOR color, char32_t c) {
-                        CES::CES_XY xy;
-                        xy.x = x;
-                        xy.y = y;
-                        xy.z = z;
-                        xy.c = c;
-                        xy.ARGB = color;
-                        unique_lock<mutex> lock_all(mtx_write); // <-- Write permission mutex
-                        if (at(x, y, frame).z >= z) return;
-                        set(x, y, change, xy);
-                        lock_all.unlock();
+                    // Every layer is gone; Cells which are still pending get the colors below them back.
+                    void dropTints() {
+                        for (auto& [i, t] : tints) {
+                            if (!damage.isDirty(int(i % width), int(i / width)) || !(change.attr[i] & CES_ATTR_TINT)) continue;
+                            change.rgba[i] = t.fg;
+                            change.bg[i] = t.bg;
+                            change.attr[i] &= ~CES_ATTR_TINT;
+                        }
+                        tints.clear();
                     }
 
-                    inline void writeCell(vector<CES::CES_XY>* xy) {
-                        for (auto& c : *xy) {
-                            unique_lock<mutex> lock_all(mtx_write);
-                            if (at(c.x, c.y, frame).z >= c.z) continue;
-                            set(c.x, c.y, change, c);
-                            lock_all.unlock();
+                    // A tinted cell of 'frame' is the same as the canvas cell, if the colors below the layers are.
+                    inline bool showsBelow(size_t i, char32_t g, uint32_t fg, uint32_t bg, uint8_t attr) const {
+                        if (frame.glyph[i] != g) return false;
+                        if (!(frame.attr[i] & CES_ATTR_TINT)) return frame.attr[i] == attr && frame.rgba[i] == fg && frame.bg[i] == bg;
+                        auto it = tints.find(i);
+                        return it != tints.end() && (frame.attr[i] & ~CES_ATTR_TINT) == attr && it->second.fg == fg && it->second.bg == bg;
+                    }
+
+                    // !
+                    // ! 'frame' is what the terminal shows, so it is moved like the terminal will move it; 'change' and 'damage'
+                    // ! move along, so cells written before the scroll move with it and the ones after it land where they were written.
+                    // ! The terminal gets the scroll at the start of the next frame, before any cell.
+                    // !
+                    void mergeScroll(const CES_ScrollWrite& sw) {
+                        int top = max(sw.top, 0), bottom = min(sw.bottom, height - 1);
+                        if (top > bottom || sw.dy == 0) return;
+                        int dy = clamp(sw.dy, -(bottom - top + 1), bottom - top + 1);
+                        frame.shiftRows(width, top, bottom, dy, 0);
+                        rehashTiles(top, bottom);
+                        change.shiftRows(width, top, bottom, dy, INT_MIN);
+                        damage.shiftRows(top, bottom, dy);
+                        if (!tints.empty()) shiftTints(top, bottom, dy);
+                        scroll_ops.push_back({ top, bottom, dy, 0, 0 });
+                        // The layers stay where they are.
+                        relayer_rows.emplace_back(top, bottom);
+                    }
+
+                    // The layers move with their cells; The ones which are moved out of [top, bottom] are gone.
+                    void shiftTints(int top, int bottom, int dy) {
+                        unordered_map<size_t, CES_TintStack> moved;
+                        for (auto& [i, t] : tints) {
+                            int y = int(i / width);
+                            if (y < top || y > bottom) moved.emplace(i, move(t));
+                            else if (y - dy >= top && y - dy <= bottom) moved.emplace(i - ptrdiff_t(dy) * width, move(t));
                         }
+                        tints = move(moved);
                     }
 
-                    void removeCell(int x, int y) {
-                        CES::CES_XY xy;
-                        xy.x = x;
-                        xy.y = y;
-                        xy.z = std::numeric_limits<int32_t>::min();
-                        xy.c = ' ';
-                        xy.ARGB = CES::CES_COLOR(0,0,0);
-                        unique_lock<mutex> lock_all(mtx_write);
-                        set(x, y, change, xy);
-                        lock_all.unlock();
+                    // The depth test for a whole row; Compare and blend, 4 cells at once with SSE2.
+                    void mergeRow(const CES_RowWrite& w) {
+                        if (w.y < 0 || w.y >= height) return;
+                        if (w.canvas) {
+                            mergeCanvasRow(w);
+                            return;
+                        }
+                        int skip = max(0, -w.x);
+                        int x0 = w.x + skip;
+                        int n = min(int(w.count) - skip, width - x0);
+                        if (n <= 0) return;
+
+                        size_t base = size_t(w.y) * width + x0;
+                        const char32_t* g = &merging.row_glyph[w.offset + skip];
+                        const uint32_t* c = &merging.row_rgba[w.offset + skip];
+                        const uint32_t* b = &merging.row_bg[w.offset + skip];
+                        const uint8_t* m = w.mask == SIZE_MAX ? nullptr : &merging.row_mask[w.mask + skip];
+                        const int32_t* fd = &frame.depth[base];
+                        int32_t* cd = &change.depth[base];
+                        char32_t* cg = &change.glyph[base];
+                        uint32_t* cc = &change.rgba[base];
+                        uint32_t* cb = &change.bg[base];
+                        uint8_t* ca = &change.attr[base];
+                        const int32_t z = w.z;
+
+                        // Wide glyphs in the row or on the screen around it need the cell by cell way; So do translucent colors ('mergeTint()').
+                        bool narrow = true;
+                        uint32_t alpha = 0xFF;
+                        for (int j = 0; j < n; j++) {
+                            narrow &= glyphs.add(g[j]).width == 1;
+                            alpha &= m && !m[j] ? 0xFF : c[j];
+                        }
+                        uint8_t around = 0;
+                        for (int j = 0, e = min(n + 1, width - x0); j < e; j++) around |= (frame.attr[base + j] | change.attr[base + j]) & CES_ATTR_CONT;
+                        if (!narrow || around || (alpha & 0xFF) != 0xFF) {
+                            const char32_t* rg = &merging.row_glyph[w.offset];
+                            const uint32_t* rc = &merging.row_rgba[w.offset];
+                            const uint32_t* rb = &merging.row_bg[w.offset];
+                            const uint8_t* rm = w.mask == SIZE_MAX ? nullptr : &merging.row_mask[w.mask];
+                            for (int j = 0, x = w.x; j < int(w.count) && x < width; j++) {
+                                if (!rm || rm[j]) mergeCell(CES_XY(x, w.y, z, CES_COLOR::from_uint(rc[j]), rg[j]), rb[j]);
+                                // A row with a mask (a sprite) is a grid: One entry per cell, the one right of a wide glyph is transparent.
+                                x += rm ? 1 : glyphs.add(rg[j]).width;
+                            }
+                            return;
+                        }
+
+                        int i = 0;
+                        #if defined(__SSE2__)
+                            const __m128i vz = _mm_set1_epi32(z);
+                            const __m128i zero = _mm_setzero_si128();
+                            auto blend = [](__m128i m, __m128i a, __m128i b) {
+                                return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
+                            };
+                            for (; i + 4 <= n; i += 4) {
+                                __m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i*>(fd + i));
+                                __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cd + i));
+                                // z > frame && !(pending > z)
+                                __m128i take = _mm_andnot_si128(_mm_cmpgt_epi32(p, vz), _mm_cmpgt_epi32(vz, f));
+                                if (m) {
+                                    // 4 mask bytes widened to 4 lanes; Transparent cells aren't taken.
+                                    uint32_t m4;
+                                    memcpy(&m4, m + i, 4);
+                                    __m128i mv = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(int(m4)), zero), zero);
+                                    take = _mm_andnot_si128(_mm_cmpeq_epi32(mv, zero), take);
+                                }
+                                int bits = _mm_movemask_ps(_mm_castsi128_ps(take));
+                                if (!bits) continue;
+
+                                _mm_storeu_si128(reinterpret_cast<__m128i*>(cd + i), blend(take, vz, p));
+                                __m128i gv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(g + i));
+                                __m128i cgv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cg + i));
+                                _mm_storeu_si128(reinterpret_cast<__m128i*>(cg + i), blend(take, gv, cgv));
+                                __m128i cv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c + i));
+                                __m128i ccv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cc + i));
+                                _mm_storeu_si128(reinterpret_cast<__m128i*>(cc + i), blend(take, cv, ccv));
+                                __m128i bv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+                                __m128i cbv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cb + i));
+                                _mm_storeu_si128(reinterpret_cast<__m128i*>(cb + i), blend(take, bv, cbv));
+                                for (int k = 0; k < 4; k++) if (bits >> k & 1) ca[i + k] = 0;
+
+                                damage.markBits(x0 + i, w.y, uint64_t(bits));
+                            }
+                        #endif
+                        // The rest (or everything without SSE2); Without branches, so the compiler can vectorize it too.
+                        for (; i < n; i++) {
+                            bool take = z > fd[i] && cd[i] <= z && (!m || m[i]);
+                            cd[i] = take ? z : cd[i];
+                            cg[i] = take ? g[i] : cg[i];
+                            cc[i] = take ? c[i] : cc[i];
+                            cb[i] = take ? b[i] : cb[i];
+                            ca[i] = take ? 0 : ca[i];
+                            damage.markBits(x0 + i, w.y, uint64_t(take));
+                        }
                     }
 
-                    void removeCell(CES::CES_XY& xy) {
-                        xy.ARGB = CES_COLOR(0,0,0);
-                        xy.c = ' ';
-                        xy.z = INT_MIN;
-                        unique_lock<mutex> lock_all(mtx_write);
-                        set(xy.x, xy.y, change, xy);
-                        lock_all.unlock();
+                    // !
+                    // ! The depth test is the one of the cells, except that the same z wins too: A canvas replaces itself.
+                    // ! A cell (or pixel pair) which is on the screen already and has nothing else pending isn't touched, so it isn't sent again.
+                    // ! Canvas cells are always narrow ('CES_GlyphCache::oneCell()').
+                    // !
+                    void mergeCanvasRow(const CES_RowWrite& w) {
+                        const char32_t* g = &merging.row_glyph[w.offset];
+                        const uint32_t* fg = &merging.row_rgba[w.offset];
+                        const uint32_t* bg = &merging.row_bg[w.offset];
+                        for (int j = max(0, -w.x); j < int(w.count) && w.x + j < width; j++) {
+                            int x = w.x + j;
+                            size_t i = size_t(w.y) * width + x;
+                            if (frame.depth[i] > w.z || change.depth[i] > w.z) continue;
+                            if (!damage.isDirty(x, w.y) && frame.depth[i] == w.z && showsBelow(i, g[j], fg[j], bg[j], w.attr)) continue;
+                            place(x, w.y, g[j], fg[j], bg[j], w.z, w.attr);
+                        }
                     }
 
-                    void removeCell(vector<CES::CES_XY>* xy) {
-                        for (auto& c : *xy) {
-                            c.ARGB = CES_COLOR(0,0,0);
-                            c.z = INT_MIN;
-                            c.c = ' ';
-                            unique_lock<mutex> lock_all(mtx_write);
-                            set(c.x, c.y, change, c);
-                            lock_all.unlock();
+                    #if !defined(_WIN32)
+                        // Lock-free, so it is safe in a signal handler; Then the handler that was there before the screens.
+                        static void onWinch(int sig, siginfo_t* info, void* context) {
+                            resize_generation.fetch_add(1, memory_order_relaxed);
+                            if (old_winch.sa_flags & SA_SIGINFO) {
+                                if (old_winch.sa_sigaction) old_winch.sa_sigaction(sig, info, context);
+                            } else if (old_winch.sa_handler != SIG_DFL && old_winch.sa_handler != SIG_IGN) {
+                                old_winch.sa_handler(sig);
+                            }
+                        }
+                    #endif
+
+                    #if !defined(_WIN32)
+                        // !
+                        // ! Asks the terminal with DECRQM (CSI ? 2026 $ p) if it knows mode 2026; The answer is CSI ? 2026 ; Ps $ y.
+                        // ! Primary DA (CSI c) is sent behind it: Every terminal answers that one, so a terminal which ignores DECRQM
+                        // ! doesn't cost the whole timeout. Without any answer (not a terminal, ...) it gives up after 'timeout_ms'.
+                        // ! Everything else on stdin until the answer is read and dropped: Keys typed before or during the probe are lost for
+                        // ! an application which reads stdin itself. 'CES_Input' reads the keyboard device, so it still sees them.
+                        // ! They can't be given back: There is no buffer for stdin to put them in, and TIOCSTI is off on newer kernels.
+                        // !
+                        static bool probeSyncOutput(int timeout_ms = 200) {
+                            if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO)) return false;
+
+                            termios oldt, newt;
+                            if (tcgetattr(STDIN_FILENO, &oldt) != 0) return false;
+                            newt = oldt;
+                            newt.c_lflag &= ~(ICANON | ECHO);
+                            newt.c_cc[VMIN] = 0;
+                            newt.c_cc[VTIME] = 0;
+                            tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+
+                            static const char query[] = "\033[?2026$p\033[c";
+                            (void)!write(STDOUT_FILENO, query, sizeof(query) - 1);
+
+                            string answer;
+                            auto until = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+                            while (true) {
+                                int left = int(chrono::duration_cast<chrono::milliseconds>(until - chrono::steady_clock::now()).count());
+                                if (left <= 0) break;
+                                pollfd p = { STDIN_FILENO, POLLIN, 0 };
+                                if (poll(&p, 1, left) <= 0) break;
+                                char buf[64];
+                                ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+                                if (n <= 0) break;
+                                answer.append(buf, size_t(n));
+                                // The answer to DA ends with 'c' and comes last; DECRQM ends with 'y'.
+                                if (answer.back() == 'c' && answer.find("\033[?") != string::npos) break;
+                            }
+                            tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+
+                            // Ps: 1 = set, 2 = reset, 3 = always set; 0 = unknown, 4 = always reset.
+                            static const char reply[] = "\033[?2026;";
+                            size_t at = answer.find(reply);
+                            if (at == string::npos || at + sizeof(reply) - 1 >= answer.size()) return false;
+                            char ps = answer[at + sizeof(reply) - 1];
+                            return ps == '1' || ps == '2' || ps == '3';
+                        }
+                    #endif
+
+                    // Asks the terminal for its size only if it was resized since the last frame. (Windows has no signal for it, so it asks every frame.)
+                    void pollResize() {
+                        #if defined(_WIN32)
+                            pair<int, int> size = WidthHeight();
+                            if (size.first != width || size.second != height) resize(size.first, size.second);
+                        #else
+                            unsigned gen = resize_generation.load(memory_order_relaxed);
+                            if (gen == seen_resize) return;
+                            seen_resize = gen;
+                            pair<int, int> size = WidthHeight();
+                            resize(size.first, size.second);
+                        #endif
+                    }
+
+                    // !
+                    // ! New size for 'frame' and 'change', allocated once; What fits into both sizes is kept, including pending cells.
+                    // ! The next frame clears the terminal and draws 'frame' again from the tile cache, so there is exactly one full repaint.
+                    // ! Has to be called with 'mtx_write' locked.
+                    // !
+                    void resize(int w, int h) {
+                        if (w <= 0 || h <= 0 || (w == width && h == height)) return;
+
+                        CES_Planes f, c;
+                        f.assign(size_t(h) * w, 0);
+                        c.assign(size_t(h) * w, INT_MIN);
+                        CES_DirtyMap d;
+                        d.resize(w, h);
+
+                        int cw = min(w, width), ch = min(h, height);
+                        for (int y = 0; y < ch; y++) {
+                            for (int x = 0; x < cw; x++) {
+                                size_t o = size_t(y) * width + x, n = size_t(y) * w + x;
+                                f.copy(n, frame, o);
+                                // What was pending stays pending.
+                                if (damage.isDirty(x, y)) {
+                                    c.copy(n, change, o);
+                                    d.mark(x, y);
+                                }
+                            }
+                            // A wide glyph whose right half was cut off.
+                            if (w < width) {
+                                size_t o = size_t(y) * width + w, n = size_t(y) * w + w - 1;
+                                if (frame.attr[o] & CES_ATTR_CONT) f.glyph[n] = U' ';
+                                if (shownAttr(w, y) & CES_ATTR_CONT) c.glyph[n] = U' ';
+                            }
+                        }
+
+                        unordered_map<size_t, CES_TintStack> t;
+                        for (auto& [i, stack] : tints) {
+                            int x = int(i % width), y = int(i / width);
+                            if (x < cw && y < ch) t.emplace(size_t(y) * w + x, move(stack));
                         }
+
+                        frame = move(f);
+                        change = move(c);
+                        damage = move(d);
+                        tints = move(t);
+                        width = w;
+                        height = h;
+                        relayer_rows.emplace_back(0, h - 1);
+                        resetTiles();
+                        repaint = true;
+                        // Reflowed by the terminal.
+                        term.cx = term.cy = -1;
+                        // The terminal is cleared anyway.
+                        scroll_ops.clear();
                     }
 
                     pair<int, int> WidthHeight() {
@@ -990,16 +3672,57 @@ class CES {
                         return {cols, rows};
                     }
 
+                    // Waits until every frame from 'OutputCurWindow()' is written to the terminal.
+                    void FlushOutput() {
+                        if (writer) writer->drain();
+                    }
+
+                    // ! Like 'Repaint()', it changes what the frames know about the terminal, so no frame may be encoded at the same time.
                     void ClearConsole() {
+                        lock_guard<mutex> lock(mtx_write);
+                        // Queued frames would end up after this; No new ones come while it is locked.
+                        FlushOutput();
+                        cout << "\033[0m";      // Otherwise the screen is cleared with the background of the last frame
                         cout << "\033[2J";      // Delete the screen
                         cout << "\033[1;1H";
                         cout << "\033[?25l";    // Hide cursor
-                        frame.clear();
-                        frame.resize(height*width);
+                        cout.flush();
+                        frame.assign(size_t(height)*width, 0);
+                        dropTints();
+                        relayer_rows.emplace_back(0, height - 1);
+                        resetTiles();
+                        term = CES_TermState();
+                        term.cx = term.cy = 0;
+                        term.known_bg = true;
+                        cursor_hidden = true;
+                    }
+
+                    // Everything is drawn again with the next frame, after the terminal was cleared; For terminals which were reset.
+                    // ! Tiles which didn't change since they were drawn the last time aren't encoded again.
+                    void Repaint() {
+                        lock_guard<mutex> lock(mtx_write);
+                        repaint = true;
+                    }
+
+                    // Ordered dithering for terminals with 256 or 16 colors: Gradients look smoother, but cost more bytes. Off by default.
+                    // ! Everything is drawn again, so the old colors don't stay where nothing changes.
+                    void SetDither(bool on) {
+                        lock_guard<mutex> lock(mtx_write);
+                        if (dither == on) return;
+                        dither = on;
+                        repaint = true;
                     }
 
-                    CES_XY& at(int x, int y, vector<CES_XY>& vec) { return vec[y*width+x]; }
-                    void set(int x, int y, vector<CES_XY>& vec, CES_XY& xy) { vec[y*width+x] = xy; }
+                    // Outside of the screen: An empty cell; The size can change with every frame.
+                    CES_XY at(int x, int y, const CES_Planes& p) const {
+                        if (x < 0 || y < 0 || x >= width || y >= height) return CES_XY(x, y, INT_MIN, CES_COLOR(), U'\0');
+                        size_t i = size_t(y)*width+x;
+                        return CES_XY(x, y, p.depth[i], CES_COLOR::from_uint(p.rgba[i]), p.glyph[i]);
+                    }
+                    void set(int x, int y, CES_Planes& p, const CES_XY& xy) {
+                        if (x < 0 || y < 0 || x >= width || y >= height) return;
+                        p.put(size_t(y)*width+x, xy);
+                    }
                     
                     struct PairHash {
                         template <class T1, class T2>
@@ -1034,9 +3757,71 @@ class CES {
                     int height = WidthHeight().second;
                     int width = WidthHeight().first;
 
-                    vector<CES_XY> change;
-                    vector<CES_XY> frame;
+                    CES_Planes change;
+                    CES_Planes frame;
+                    CES_DirtyMap damage;
+                    // Only for cells with translucent layers; Their blended colors are in 'frame' and 'change'.
+                    unordered_map<size_t, CES_TintStack> tints;
+
+                    mutex layers_mtx;                       // Guards 'layers' and 'layer_order'
+                    vector<unique_ptr<CES_Layer>> layers;   // In the order they were added; Their index is their handle.
+                    vector<CES_Layer*> layer_order;         // Highest z first
+                    vector<uint64_t> layer_todo;            // Positions to resolve in the next 'composeLayers()'
+                    vector<pair<int, int>> relayer_rows;    // Rows [top, bottom] whose layer cells are resolved again (scrolls, resizes, ...)
+                    CES_GlyphCache glyphs;      // Only changed while merging
+
+                    // One staging buffer per producer thread; 'staging()' finds it again through 'screen_id'.
+                    static uint64_t newScreenId() {
+                        static atomic<uint64_t> next{0};
+                        return ++next;
+                    }
+
+                    const uint64_t screen_id = newScreenId();
+                    mutex staging_mtx;      // Guards 'stagings'
+                    vector<shared_ptr<CES_Staging>> stagings;       // In the order they are merged
+                    size_t staging_limit = size_t(1) << 18;         // Writes per buffer; About 5 MB of cells
+                    CES_Staging merging;
+
+                    // Which SGR form the terminal gets; Follows 'supported'.
+                    CES_ColorMode color_mode = CES_16COLOR;
+                    bool dither = false;        // 'SetDither()'
+                    // One per band.
+                    vector<CES_OutputPlanner> tile_plan;
+                    vector<int> row_dirty;
+                    vector<int> bands;
+                    CES_FrameStats stats;
+                    bool repaint = false;       // Set by 'resize()' and 'Repaint()'; The next frame clears the terminal and draws 'frame' again.
+                    // ! Nothing but the frames may write to the terminal, otherwise this is wrong; 'ClearConsole()' keeps it up to date.
+                    CES_TermState term;
+                    bool cursor_hidden = false;
+                    vector<CES_TileCache> tile_cache;       // Row by row
+                    int tiles_x = 0;
+                    int tiles_y = 0;
+                    vector<int> tile_misses;
+                    vector<CES_ScrollWrite> scroll_ops;     // Merged, but not sent yet
+
+                    #if !defined(_WIN32)
+                        // Shared by every screen of the process; Written by the SIGWINCH handler.
+                        static inline atomic<unsigned> resize_generation{0};
+                        static_assert(atomic<unsigned>::is_always_lock_free);
+                        unsigned seen_resize = 0;
+                        static inline mutex winch_mtx;          // Guards 'winch_screens' and 'old_winch'
+                        static inline int winch_screens = 0;    // Screens alive; The handler is installed while there are any
+                        static inline struct sigaction old_winch = {};     // The handler of the application, called by 'onWinch()'
+                    #endif
+
+                    // Pacing of the render loop: 'OutputCurWindow()' and then 'frame_clock.wait()'.
+                    CES_FrameClock frame_clock;
                     mutex mtx_write;
+
+                    // A compiler definition for opening the 'CES_THREAD_POOL'-Unit.
+                    // ! Note: Basically you don't have to define 'CES_THREAD_POOL' in your main code when you are defining: 'CES_CELL_SYSTEM'.
+                    #define CES_THREAD_POOL
+
+                    // Workers for rendering the tiles of a frame; Created once in the constructor.
+                    unique_ptr<ThreadPool> render_pool;
+                    // Writes the frames to the terminal; Created in the constructor after the terminal is set up.
+                    unique_ptr<CES_FrameWriter> writer;
                     
                     #if defined(_WIN32)
                         HANDLE hOut;
@@ -1080,6 +3865,9 @@ class CES {
                         shutdown();
                     }
 
+                    /* Amount of one-time workers */
+                    size_t size() const noexcept { return workers.size(); }
+
                     /* Works once not consistent */
                     void enqueue(Task task) {
                         {
@@ -1277,42 +4065,11 @@ class CES {
             #define CES_ACC_O(r,g,b,a,v1,v2,v3,v4) ((r) == (v1) || (g) == (v2) || (b) == (v3) || (a) == (v4)) 
 
             // Rounding the input colors down or up to let it fit into a 16-color or 8-color terminal
+            // The nearest of the CES_16_* colors (or of the first 8 of them); The alpha stays.
             void CES_ROUND_COLORS(CES_COLOR* color, bool form = true) { // True = 16-color, False = 8 color
-                // Areas: 0 < 128 < 192 < 255
-                // After division with 64 it is: 0, 2, 3, 4
-
-                short red = round(color->r / 64);
-                short green = round(color->g / 64);
-                short blue = round(color->b / 64);
-
-                // 64 isn't available for those terminals
-
-                if (red == 1) red++;
-                if (green == 1) green++;
-                if (blue == 1) blue++;
-
-                // First if is RED, second is GREEN, third is BLUE
-                // It's not the best solution till now, but it makes it easier to read
-                // 8 color terminal
-                    if (CES_CC_A(red, green, blue, 0,0,0))    color->Convert_Without_Alpha(CES_16_BLACK);
-                else if (CES_CC_A(red, green, blue, 2,0,0))   color->Convert_Without_Alpha(CES_16_RED);
-                else if (CES_CC_A(red, green, blue, 0,2,0))   color->Convert_Without_Alpha(CES_16_GREEN);
-                else if (CES_CC_A(red, green, blue, 2,2,0))   color->Convert_Without_Alpha(CES_16_YELLOW);
-                else if (CES_CC_A(red, green, blue, 0,0,2))   color->Convert_Without_Alpha(CES_16_BLUE);
-                else if (CES_CC_A(red, green, blue, 2,0,2))   color->Convert_Without_Alpha(CES_16_MAGENTA);
-                else if (CES_CC_A(red, green, blue, 0,2,2))   color->Convert_Without_Alpha(CES_16_CYAN);
-                else if (CES_CC_A(red, green, blue, 3,3,3))   color->Convert_Without_Alpha(CES_16_LIGHT_GRAY);
-                // 16 color terminal
-                else if (CES_CC_A(red, green, blue, 2,2,2))   color->Convert_Without_Alpha(CES_16_GRAY);
-                else if (CES_CC_A(red, green, blue, 4,0,0))   color->Convert_Without_Alpha(CES_16_BRIGHT_RED);
-                else if (CES_CC_A(red, green, blue, 0,4,0))   color->Convert_Without_Alpha(CES_16_BRIGHT_GREEN);
-                else if (CES_CC_A(red, green, blue, 4,4,0))   color->Convert_Without_Alpha(CES_16_BRIGHT_YELLOW);
-                else if (CES_CC_A(red, green, blue, 0,0,4))   color->Convert_Without_Alpha(CES_16_BRIGHT_BLUE);
-                else if (CES_CC_A(red, green, blue, 4,0,4))   color->Convert_Without_Alpha(CES_16_BRIGHT_MAGENTA);
-                else if (CES_CC_A(red, green, blue, 0,4,4))   color->Convert_Without_Alpha(CES_16_BRIGHT_CYAN);
-                else if (CES_CC_A(red, green, blue, 4,4,4))   color->Convert_Without_Alpha(CES_16_WHITE);
-
-                return;
+                const CES_Palette& palette = CES_Palette::get();
+                uint32_t i = CES_Palette::index(color->to_uint());
+                color->Convert_Without_Alpha(CES_Palette::ansi[form ? palette.to16[i] : palette.to8[i]]);
             }
         #endif
 
@@ -1513,6 +4270,11 @@ class CES {
                         }
 
                         vector<CES::CES_XY>* pack_load_system_line() { return &l; }
+
+                        // Straight into a Braille canvas; 'd' and 'e' are dots there, not cells.
+                        static void rasterize(CES::CES_BrailleCanvas& canvas, const CES::CES_XY& d, const CES::CES_XY& e) {
+                            canvas.line(d.x, d.y, e.x, e.y);
+                        }
                     };
 
                     struct CES_Circle {
@@ -1564,6 +4326,32 @@ class CES {
                         }
 
                         vector<CES::CES_XY>* pack_load_system_circle() { return &l; }
+
+                        // Straight into a Braille canvas, around 'd' through 'e' (both dots); The dots are about square, so no 'xScale'.
+                        // ! Midpoint circle; In the flat octants the dots of one row are one span.
+                        static void rasterize(CES::CES_BrailleCanvas& canvas, const CES::CES_XY& d, const CES::CES_XY& e) {
+                            int dx = e.x - d.x, dy = e.y - d.y;
+                            int r = int(round(sqrt(double(dx) * dx + double(dy) * dy)));
+                            int x = r, y = 0, err = 1 - r, run = 0;
+                            while (x >= y) {
+                                canvas.plot(d.x + x, d.y + y);
+                                canvas.plot(d.x - x, d.y + y);
+                                canvas.plot(d.x + x, d.y - y);
+                                canvas.plot(d.x - x, d.y - y);
+                                int px = x, py = y;
+                                y++;
+                                if (err < 0) err += 2 * y + 1;
+                                else { x--; err += 2 * (y - x) + 1; }
+                                // Row 'px' is done.
+                                if (x != px || x < y) {
+                                    canvas.span(d.y + px, d.x + run, d.x + py);
+                                    canvas.span(d.y + px, d.x - py, d.x - run);
+                                    canvas.span(d.y - px, d.x + run, d.x + py);
+                                    canvas.span(d.y - px, d.x - py, d.x - run);
+                                    run = y;
+                                }
+                            }
+                        }
                     };
 
                     struct CES_Polygon {
@@ -1574,20 +4362,8 @@ class CES {
 
                         CES_Polygon(int Z) : z(Z) {}
 
-                        void calculate_polygon(const unordered_set<CES::CES_XY, CES::CES_XY::CES_XY_Hash>& xy, char32_t c, CES::CES_COLOR color, bool change = false)
-                        {
-                            // Exit if polygon is unchanged
-                            if (exist == xy)
-                                return;
-
-                            exist = xy;
-
-                            clean = move(l);
-                            l.clear();
-
-                            if (xy.size() < 2)
-                                return;
-
+                        // The corners in the order they are connected.
+                        static vector<CES::CES_XY> outline(const unordered_set<CES::CES_XY, CES::CES_XY::CES_XY_Hash>& xy) {
                             vector<CES::CES_XY> tmp;
                             tmp.reserve(xy.size());
                             tmp.insert(tmp.end(), xy.begin(), xy.end());
@@ -1613,6 +4389,24 @@ class CES {
                                     double db = (b.x - cx) * (b.x - cx) + (b.y - cy) * (b.y - cy);
                                     return da < db;
                                 });
+                            return tmp;
+                        }
+
+                        void calculate_polygon(const unordered_set<CES::CES_XY, CES::CES_XY::CES_XY_Hash>& xy, char32_t c, CES::CES_COLOR color, bool change = false)
+                        {
+                            // Exit if polygon is unchanged
+                            if (exist == xy)
+                                return;
+
+                            exist = xy;
+
+                            clean = move(l);
+                            l.clear();
+
+                            if (xy.size() < 2)
+                                return;
+
+                            vector<CES::CES_XY> tmp = outline(xy);
 
                             // Bresenham
                             auto draw_line =
@@ -1669,6 +4463,17 @@ class CES {
                         }
 
                         vector<CES::CES_XY>* pack_load_system_polygon() { return &l; }
+
+                        // Straight into a Braille canvas; The corners are dots there, not cells.
+                        static void rasterize(CES::CES_BrailleCanvas& canvas, const unordered_set<CES::CES_XY, CES::CES_XY::CES_XY_Hash>& xy) {
+                            if (xy.size() < 2) return;
+                            vector<CES::CES_XY> tmp = outline(xy);
+                            for (size_t i = 0; i < tmp.size(); i++) {
+                                const CES::CES_XY& a = tmp[i];
+                                const CES::CES_XY& b = tmp[(i + 1) % tmp.size()];
+                                canvas.line(a.x, a.y, b.x, b.y);
+                            }
+                        }
                     };
 
                     struct CES_Ellipse {
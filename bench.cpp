@@ -0,0 +1,272 @@
+// Benchmarks of the cell system; Not part of the engine. POSIX only: The screens draw into a pseudo terminal.
+// g++ -O2 -std=c++20 -pthread bench.cpp -o bench && ./bench [name]
+#define CES_CELL_SYSTEM
+#include "CES_Engine.hpp"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <sys/resource.h>
+
+using bench_clock = chrono::steady_clock;
+
+// The results; The real stdout, even after 'benchTerminal()' took it over for the screen.
+static FILE* report = stdout;
+
+static double nsSince(bench_clock::time_point t0) {
+    return chrono::duration<double, nano>(bench_clock::now() - t0).count();
+}
+
+// !
+// ! The screens draw into a pseudo terminal of 100 x 30, whose output is read and thrown away;
+// ! So the numbers don't depend on the terminal the benchmark runs in. Set up once, for every screen after it.
+// !
+static void benchTerminal() {
+    static once_flag once;
+    call_once(once, [] {
+        setenv("TERM", "xterm-256color", 1);
+        setenv("COLORTERM", "truecolor", 1);
+        int master = posix_openpt(O_RDWR | O_NOCTTY);
+        if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+            fprintf(report, "no pseudo terminal\n");
+            exit(1);
+        }
+        int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+        winsize ws = {};
+        ws.ws_col = 100;
+        ws.ws_row = 30;
+        ioctl(slave, TIOCSWINSZ, &ws);
+        cout.flush();
+        dup2(slave, STDOUT_FILENO);
+        // Nobody answers the probe of the screen, so it gives up after its timeout.
+        dup2(slave, STDIN_FILENO);
+        close(slave);
+        thread([master] {
+            char buf[1 << 16];
+            while (read(master, buf, sizeof(buf)) > 0) {}
+        }).detach();
+    });
+}
+
+// One cell as the tile encoders wrote it before CES_AnsiEncoder: CUP, SGR, glyph and reset, each from to_string() pieces.
+static void encodeWithStrings(string& out, const CES::CES_XY& c) {
+    out += "\033[" + to_string(c.y + 1) + ";" + to_string(c.x + 1) + "H";
+    out += "\033[38;2;" + to_string(int(c.ARGB.r)) + ";" + to_string(int(c.ARGB.g)) + ";" + to_string(int(c.ARGB.b)) + "m";
+    out += c.convertCHAR32toCHAR(c.c);
+    out += "\033[0m";
+}
+
+// user-003: ns per cell of the escape encoder, against the old string concatenation.
+static void benchEncoder() {
+    const int w = 400, h = 120, reps = 20;
+    vector<CES::CES_XY> cells;
+    for (int i = 0; i < w * h; i++) cells.emplace_back(i % w, i / w, 1, CES::CES_COLOR(i * 7, i * 13, i * 3), U'#');
+
+    size_t bytes = 0;
+    auto t0 = bench_clock::now();
+    for (int r = 0; r < reps; r++) {
+        string out;
+        for (const auto& c : cells) encodeWithStrings(out, c);
+        bytes += out.size();
+    }
+    double strings = nsSince(t0) / (double(reps) * cells.size());
+
+    CES::CES_ByteBuffer buf;
+    t0 = bench_clock::now();
+    for (int r = 0; r < reps; r++) {
+        buf.clear();
+        for (const auto& c : cells) {
+            CES::CES_AnsiEncoder::cup(buf, c.x, c.y);
+            CES::CES_AnsiEncoder::sgr<CES::CES_TRUECOLOR>(buf, true, c.ARGB.to_uint(), false, 0);
+            CES::CES_AnsiEncoder::utf8(buf, c.c);
+            CES::CES_AnsiEncoder::reset(buf);
+        }
+        bytes += buf.size();
+    }
+    double encoder = nsSince(t0) / (double(reps) * cells.size());
+
+    fprintf(report, "encoder: %d cells, to_string %.1f ns/cell, CES_AnsiEncoder %.1f ns/cell (%.1fx) [%zu bytes]\n",
+        w * h, strings, encoder, strings / encoder, bytes);
+}
+
+// user-004: Bytes per frame of a fixed random workload (runs of a few colors), against a CUP and an SGR for every written cell.
+static void benchPlanner() {
+    benchTerminal();
+    CES::CES_Screen s;
+    mt19937 rng(1);
+    const CES::CES_COLOR colors[4] = { CES::CES_COLOR(255, 255, 255), CES::CES_COLOR(30, 200, 70), CES::CES_COLOR(250, 80, 20), CES::CES_COLOR(40, 90, 255) };
+    const int frames = 40;
+    size_t naive = 0;
+    CES::CES_ByteBuffer buf;
+    for (int f = 0; f < frames; f++) {
+        set<pair<int, int>> written;
+        for (int k = 0; k < 60; k++) {
+            // Short runs along a row, like text and sprites.
+            int x = int(rng() % s.width), y = int(rng() % s.height), n = 1 + int(rng() % 8);
+            const CES::CES_COLOR& c = colors[rng() % 4];
+            for (int i = 0; i < n && x + i < s.width; i++) {
+                s.writeCell(x + i, y, f + 1, c, char32_t('a' + rng() % 26));
+                if (!written.insert({ x + i, y }).second) continue;
+                buf.clear();
+                CES::CES_AnsiEncoder::cup(buf, x + i, y);
+                CES::CES_AnsiEncoder::sgr<CES::CES_TRUECOLOR>(buf, true, c.to_uint(), false, 0);
+                naive += buf.size() + 1;
+            }
+        }
+        s.OutputCurWindow();
+        s.FlushOutput();
+    }
+    fprintf(report, "planner: %d frames %dx%d, %zu bytes/frame, CUP + SGR per cell %zu bytes/frame\n",
+        frames, s.width, s.height, s.stats.total_bytes / max<size_t>(s.stats.frames, 1), naive / frames);
+}
+
+// !
+// ! user-009: 1 to 8 producer threads write batches of 64 cells as fast as they can, while the main thread renders
+// ! at the pace of 'frame_clock'. Producers only wait for their own buffer, so the writes should scale with the cores.
+// ! Then 8 producers without any frames: 'staging_limit' has to keep the memory bounded.
+// !
+static void benchProducers() {
+    benchTerminal();
+    for (int n : { 1, 2, 4, 8, -8 }) {
+        bool render = n > 0;
+        n = abs(n);
+        CES::CES_Screen s;
+        atomic_bool run{true};
+        atomic<size_t> writes{0};
+        vector<thread> producers;
+        for (int p = 0; p < n; p++) {
+            producers.emplace_back([&, p] {
+                s.setProducerOrder(p);
+                mt19937 rng(p);
+                vector<CES::CES_XY> batch;
+                size_t mine = 0;
+                while (run) {
+                    batch.clear();
+                    for (int i = 0; i < 64; i++) batch.emplace_back(int(rng() % s.width), int(rng() % s.height), 1 + p, CES::CES_COLOR(40 * p, 255, 90), char32_t('a' + p));
+                    s.writeCells(batch);
+                    mine += batch.size();
+                }
+                writes += mine;
+            });
+        }
+        auto t0 = bench_clock::now();
+        while (bench_clock::now() - t0 < chrono::milliseconds(500)) {
+            if (!render) {
+                this_thread::sleep_for(chrono::milliseconds(10));
+                continue;
+            }
+            s.OutputCurWindow();
+            s.frame_clock.wait();
+        }
+        run = false;
+        for (auto& t : producers) t.join();
+        double sec = nsSince(t0) / 1e9;
+        s.FlushOutput();
+        rusage ru = {};
+        getrusage(RUSAGE_SELF, &ru);
+        fprintf(report, "producers: %d threads%s, %.1f M writes/s, %zu frames, max RSS %ld MB\n",
+            n, render ? "" : " without frames", writes / sec / 1e6, s.stats.frames, ru.ru_maxrss / 1024);
+    }
+}
+
+// user-010: ns per cell to stage and merge whole rows, through 'writeRow()' (SSE2 depth test) and through 'writeCells()'.
+static void benchRows() {
+    benchTerminal();
+    CES::CES_Screen s;
+    const int reps = 200;
+    vector<char32_t> glyphs(s.width, U'#');
+    vector<CES::CES_XY> cells;
+    double row_stage = 0, row_merge = 0, cell_stage = 0, cell_merge = 0;
+    int z = 1;
+    for (int r = 0; r < reps; r++) {
+        // Every frame starts from a screen without pending cells, both ways take every cell.
+        auto t0 = bench_clock::now();
+        for (int y = 0; y < s.height; y++) s.writeRow(0, y, z, glyphs, CES::CES_COLOR(20, 200, 90));
+        row_stage += nsSince(t0);
+        t0 = bench_clock::now();
+        {
+            lock_guard<mutex> lock(s.mtx_write);
+            s.mergeStagings();
+        }
+        row_merge += nsSince(t0);
+        s.OutputCurWindow();
+        s.FlushOutput();
+        z++;
+
+        cells.clear();
+        for (int y = 0; y < s.height; y++) {
+            for (int x = 0; x < s.width; x++) cells.emplace_back(x, y, z, CES::CES_COLOR(200, 20, 90), U'#');
+        }
+        t0 = bench_clock::now();
+        s.writeCells(cells);
+        cell_stage += nsSince(t0);
+        t0 = bench_clock::now();
+        {
+            lock_guard<mutex> lock(s.mtx_write);
+            s.mergeStagings();
+        }
+        cell_merge += nsSince(t0);
+        s.OutputCurWindow();
+        s.FlushOutput();
+        z++;
+    }
+    double n = double(reps) * s.width * s.height;
+    fprintf(report, "rows: writeRow %.2f + %.2f ns/cell (stage + merge), writeCells %.2f + %.2f ns/cell\n",
+        row_stage / n, row_merge / n, cell_stage / n, cell_merge / n);
+}
+
+// user-016: Bytes of a log pane (rows 2 to 27, one new line per frame), scrolled by the terminal and rewritten line by line.
+static void benchScroll() {
+    benchTerminal();
+    const int top = 2, bottom = 27, frames = 100;
+    auto line = [](int n) {
+        string s = "[" + to_string(n) + "] event " + to_string(n * 7919 % 1000) + " done";
+        return u32string(s.begin(), s.end());
+    };
+    size_t bytes[2] = {};
+    for (int hw = 0; hw < 2; hw++) {
+        CES::CES_Screen s;
+        vector<u32string> lines;
+        for (int f = 0; f < frames; f++) {
+            lines.push_back(line(f));
+            int shown = min(int(lines.size()), bottom - top + 1);
+            if (hw) {
+                s.scrollRegion(top, bottom, 1);
+                s.writeRow(0, bottom, f + 1, lines.back(), CES::CES_COLOR(180, 220, 180));
+            } else {
+                // Every line of the pane again, one row up; The rest of each row is cleared with spaces.
+                for (int r = 0; r < shown; r++) {
+                    u32string text = lines[lines.size() - shown + r];
+                    text.resize(s.width, U' ');
+                    s.writeRow(0, bottom - shown + 1 + r, f + 1, text, CES::CES_COLOR(180, 220, 180));
+                }
+            }
+            s.OutputCurWindow();
+            s.FlushOutput();
+        }
+        bytes[hw] = s.stats.total_bytes;
+    }
+    fprintf(report, "scroll: %d frames, rewritten %zu bytes, scrollRegion() %zu bytes\n", frames, bytes[0], bytes[1]);
+}
+
+struct Bench {
+    const char* name;
+    void (*run)();
+};
+
+static const Bench benches[] = {
+    { "encoder", benchEncoder },
+    { "planner", benchPlanner },
+    { "producers", benchProducers },
+    { "rows", benchRows },
+    { "scroll", benchScroll },
+};
+
+int main(int argc, char** argv) {
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    setvbuf(report, nullptr, _IOLBF, 0);
+    for (const Bench& b : benches) {
+        if (argc < 2 || strcmp(argv[1], b.name) == 0) b.run();
+    }
+    return 0;
+}
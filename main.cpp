@@ -21,17 +21,20 @@ int main() {
 
         bool run = true;
 
-        thr.start_persistent([&run, &input](atomic_bool& running) {
+        // Every loop has its own clock, since every loop runs on its own thread.
+        CES::CES_FrameClock quit_clock(60), input_clock(60), move_clock(60);
+
+        thr.start_persistent([&run, &input, &quit_clock](atomic_bool& running) {
             if (input.isDown(CES::ALT) && input.isDown(CES::F5)) run = false;
-            this_thread::sleep_for(chrono::milliseconds(16));
+            quit_clock.wait();
         });
 
-        thr.start_persistent([&run, &input](atomic_bool& running) {
+        thr.start_persistent([&run, &input, &input_clock](atomic_bool& running) {
             input.update();
-            this_thread::sleep_for(chrono::milliseconds(16));
+            input_clock.wait();
         });
 
-        thr.start_persistent([&input, &sys, &pt1, &pt2, &pt3, &pt4, &qdt1, &trans](atomic_bool& running) { 
+        thr.start_persistent([&input, &sys, &pt1, &pt2, &pt3, &pt4, &qdt1, &trans, &move_clock](atomic_bool& running) { 
             
             CES::CES_Shapes::CES_Polygon qdt1_cpy = qdt1;
             int x = 0, y = 0;
@@ -46,12 +49,14 @@ int main() {
                 trans.fill_shape(qdt1.pack_load_system_polygon(), CES::CES_COLOR(255,155,255), '1');
                 sys.writeCell(qdt1.pack_load_system_polygon());
                 sys.removeCell(qdt1_cpy.pack_load_system_polygon());
-                this_thread::sleep_for(chrono::milliseconds(16));
             }
+            move_clock.wait();
         });
+
+        sys.frame_clock.setTargetFPS(60);
         while (run) {
             sys.OutputCurWindow();
-            this_thread::sleep_for(chrono::milliseconds(16));
+            sys.frame_clock.wait();
         }
     } catch (std::exception& e) {
         ofstream("Debug.txt") << e.what() << endl;